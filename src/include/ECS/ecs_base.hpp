@@ -5,19 +5,123 @@
 #include <stdint.h>
 #include <bitset>
 #include <array>
+#include <vector>
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <cstddef>
+#include <utility>
+#include <tuple>
+#include <type_traits>
+#include <cstring>
+#include <cstdlib>
+#include <string>
+#include <atomic>
+#include <bit>
 #include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
 
 // ecs built from Austin Morlan's Tutorial (https://austinmorlan.com/posts/entity_component_system/) & modded
 
 namespace ecs
 {
-  using Entity = uint32_t;
-  const Entity MAX_ENTITIES = 10000;
+  // Entities are handles packing the index of the entity's slot with the
+  // slot's generation. Destroying an entity bumps the generation, so handles
+  // kept around after that no longer match once the index is reused. The
+  // generation gets 32 bits, so a slot has to be reused 2^32 times before an
+  // old handle can match again
+  using Entity = uint64_t;
+  constexpr uint32_t ENTITY_INDEX_BITS = 32;
+  constexpr Entity ENTITY_INDEX_MASK = (Entity{1} << ENTITY_INDEX_BITS) - 1; // Also the index of no entity
+
+  inline constexpr Entity entityIndex(Entity entity)
+  {
+    return entity & ENTITY_INDEX_MASK;
+  }
+
+  inline constexpr Entity entityGeneration(Entity entity)
+  {
+    return entity >> ENTITY_INDEX_BITS;
+  }
+
+  inline constexpr Entity makeEntity(Entity index, Entity generation)
+  {
+    return (generation << ENTITY_INDEX_BITS) | index;
+  }
+
+  constexpr Entity NULL_ENTITY = makeEntity(ENTITY_INDEX_MASK, 0); // Never refers to an entity
+
+  // Entities made in one batch, e.g. by createEntities. Freed slots are
+  // reused first, so the handles aren't necessarily consecutive
+  struct EntityRange
+  {
+    std::vector<Entity> mEntities{};
+
+    inline Entity operator[](size_t index) const
+    {
+      return mEntities[index];
+    }
+
+    inline size_t size() const
+    {
+      return mEntities.size();
+    }
+
+    inline std::vector<Entity>::const_iterator begin() const
+    {
+      return mEntities.begin();
+    }
+
+    inline std::vector<Entity>::const_iterator end() const
+    {
+      return mEntities.end();
+    }
+  };
 
   using ComponentType = uint32_t;
-  const ComponentType MAX_COMPONENTS = 1000;
 
-  using Signature = std::bitset<MAX_COMPONENTS>;
+  // Limits of a world, passed to BasicCoordinator. Entity storage grows on
+  // demand, MaxEntities only caps it. A signature has one bit per component
+  // type, so a world with up to 64 types gets one that fits in a register
+  template<Entity MaxEntities, ComponentType MaxComponents>
+  struct WorldConfig
+  {
+    static_assert(MaxEntities <= ENTITY_INDEX_MASK, "MaxEntities exceeds the entity index range");
+
+    static constexpr Entity MAX_ENTITIES = MaxEntities;
+    static constexpr ComponentType MAX_COMPONENTS = MaxComponents;
+
+    using Signature = std::bitset<MaxComponents>;
+  };
+
+  using DefaultConfig = WorldConfig<ENTITY_INDEX_MASK, 1000>;
+
+  using Signature = DefaultConfig::Signature; // Signature of the default Coordinator
+
+  // Calls func(index) for every set bit of bits, lowest first. Goes a 64 bit
+  // word at a time and stops after the highest set bit, so the cost follows
+  // the set bits rather than N
+  template<size_t N, typename F>
+  inline void forEachSetBit(std::bitset<N> bits, F&& func)
+  {
+    static const std::bitset<N> lowWord = std::bitset<N>{}.flip() >> (N > 64 ? N - 64 : 0);
+    for (size_t base = 0; bits.any(); base += 64)
+    {
+      for (uint64_t word = (bits & lowWord).to_ullong(); word; word &= word - 1)
+      {
+        func(base + std::countr_zero(word));
+      }
+      if constexpr (N <= 64)
+      {
+        break;
+      }
+      else
+      {
+        bits >>= 64;
+      }
+    }
+  }
 
   template<typename Args>
   void (*logCrit)(Args args...);
@@ -30,428 +134,4089 @@ namespace ecs
   template<typename Args>
   void (*logDebug)(Args args...);
 
-  class IComponentArray
+  // Hands out consecutive indices per Family, one to every type asking for
+  // one. The index is fixed on first use, afterwards looking it up is a load
+  // of a function-local static
+  template<typename Family>
+  class TypeIndex
   {
   public:
-    //virtual ~IComponentArray() = default;
-    virtual void entityDestroyed(Entity entity) = 0;
+    template<typename T>
+    inline static size_t get()
+    {
+      static const size_t index = sNextIndex++;
+      return index;
+    }
+
+  private:
+    inline static std::atomic<size_t> sNextIndex{};
   };
 
-  template<typename T>
-  class ComponentArray : IComponentArray
+  // Maps entities to indices into a packed array. The sparse side is paged so
+  // that only ranges of entity IDs which are actually in use allocate memory,
+  // the dense side lists the contained entities in the order of their data.
+  // The sparse side is indexed by entity index, an entity of an older
+  // generation isn't contained.
+  class SparseSet
   {
   public:
-    std::array<T, MAX_ENTITIES> mComponentArray{};
+    static constexpr size_t PAGE_SIZE = 4096;
+    static constexpr uint32_t INVALID_INDEX = UINT32_MAX;
 
-    absl::flat_hash_map<Entity, size_t> mEntityToIndexMap{};
+    // Compares the whole handle, so a stale one never matches the entity now
+    // holding its index
+    inline bool contains(Entity entity) const
+    {
+      return holds(entity) && mDense[index(entity)] == entity;
+    }
 
-    absl::flat_hash_map<size_t, Entity> mIndexToEntityMap{};
+    // Expects the entity to be contained
+    inline size_t index(Entity entity) const
+    {
+      Entity position = entityIndex(entity);
+      return mSparse[position / PAGE_SIZE][position % PAGE_SIZE];
+    }
 
-    size_t mSize;
+    // Whether entity's index is in use, by entity or by another generation
+    inline bool holds(Entity entity) const
+    {
+      Entity position = entityIndex(entity);
+      size_t page = position / PAGE_SIZE;
+      return page < mSparse.size() && mSparse[page]
+        && mSparse[page][position % PAGE_SIZE] != INVALID_INDEX;
+    }
 
-  public:
-    // inline ComponentArray()
-    //  : mComponentArray(std::array<T, MAX_ENTITIES>{})
-    // {};
+    // Appends the entity to the dense side and returns its index. Expects the
+    // entity's index not to be held, a stale handle would otherwise take over
+    // the slot of the living entity
+    inline size_t insert(Entity entity)
+    {
+      assert(!holds(entity));
+      Entity position = entityIndex(entity);
+      size_t newIndex = mDense.size();
+      assure(position / PAGE_SIZE)[position % PAGE_SIZE] = static_cast<uint32_t>(newIndex);
+      mDense.push_back(entity);
+      return newIndex;
+    }
 
-    inline void insertData(Entity entity, T component)
+    // Fills the hole left by the entity with the last element and returns the
+    // index of the hole. Expects the entity to be contained
+    inline size_t erase(Entity entity)
     {
-      if (mEntityToIndexMap.find(entity) != mEntityToIndexMap.end())
-      {
-        LOG_ERROR("Tried adding same component to entity multiple times - adding nothing");
-        return;
-      }
+      size_t indexOfRemovedEntity = index(entity);
+      Entity positionOfLastElement = entityIndex(mDense.back());
+      Entity position = entityIndex(entity);
 
-      size_t newIndex = mSize;
-      mEntityToIndexMap[entity] = newIndex;
-      mIndexToEntityMap[newIndex] = entity;
-      mComponentArray[newIndex] = component;
-      ++mSize;
+      mDense[indexOfRemovedEntity] = mDense.back();
+      mSparse[positionOfLastElement / PAGE_SIZE][positionOfLastElement % PAGE_SIZE] = static_cast<uint32_t>(indexOfRemovedEntity);
+      mSparse[position / PAGE_SIZE][position % PAGE_SIZE] = INVALID_INDEX;
+      mDense.pop_back();
+
+      return indexOfRemovedEntity;
     }
 
-    inline void removeData(Entity entity)
+    // The contained ones of entities, ordered by descending dense index.
+    // Erasing them in this order fills every hole from an element that stays
+    // rather than from one about to be erased, one move per erased element
+    inline std::vector<Entity> highestFirst(const std::vector<Entity>& entities) const
     {
-      if (mEntityToIndexMap.find(entity) == mEntityToIndexMap.end())
+      std::vector<Entity> contained{};
+      for (Entity entity : entities)
       {
-        LOG_ERROR("Tried removing non-existent entity - removing nothing");
-        return;
+        if (contains(entity))
+        {
+          contained.push_back(entity);
+        }
       }
-
-      size_t indexOfRemovedEntity = mEntityToIndexMap[entity];
-      size_t indexOfLastElement = mSize - 1;
-      mComponentArray[indexOfRemovedEntity] = mComponentArray[indexOfLastElement];
-
-      Entity entityOfLastElement = mIndexToEntityMap[indexOfLastElement];
-      mEntityToIndexMap[entityOfLastElement] = indexOfRemovedEntity;
-      mIndexToEntityMap[indexOfRemovedEntity] = entityOfLastElement;
-
-      mEntityToIndexMap.erase(entity);
-      mIndexToEntityMap.erase(indexOfLastElement);
-
-      --mSize;
+      std::sort(contained.begin(), contained.end(), [&](Entity a, Entity b)
+      {
+        return index(a) > index(b);
+      });
+      return contained;
     }
 
-    inline T& getData(Entity entity)
+    inline void clear()
     {
-      if (mEntityToIndexMap.find(entity) == mEntityToIndexMap.end())
+      for (Entity entity : mDense)
       {
-        LOG_ERROR("Tried to retrieve data of non-existent entity");
-        assert(false);
+        Entity position = entityIndex(entity);
+        mSparse[position / PAGE_SIZE][position % PAGE_SIZE] = INVALID_INDEX;
       }
+      mDense.clear();
+    }
 
-      return mComponentArray[mEntityToIndexMap[entity]];
+    inline size_t size() const
+    {
+      return mDense.size();
     }
 
-    inline void entityDestroyed(Entity entity) override
+    inline const std::vector<Entity>& entities() const
     {
-      if (mEntityToIndexMap.find(entity) != mEntityToIndexMap.end())
-      {
-        removeData(entity);
-      }
+      return mDense;
     }
-  };
 
-  class ComponentManager
-  {
   public:
-    template<typename T>
-    inline void registerComponent()
-    {
-      const char* typeName = typeid(T).name();
+    std::vector<std::unique_ptr<uint32_t[]>> mSparse{};
+    std::vector<Entity> mDense{};
 
-      if (mComponentTypes.find(typeName) != mComponentTypes.end())
+  private:
+    inline uint32_t* assure(size_t page)
+    {
+      if (page >= mSparse.size())
       {
-        LOG_ERROR("Tried to register already registered component type - not registering anything");
-        return;
+        mSparse.resize(page + 1);
       }
+      if (!mSparse[page])
+      {
+        mSparse[page].reset(new uint32_t[PAGE_SIZE]);
+        std::fill_n(mSparse[page].get(), PAGE_SIZE, INVALID_INDEX);
+      }
+      return mSparse[page].get();
+    }
+  };
 
-      mComponentTypes.insert({typeName, mNextComponentType});
-
-      mComponentArrays.insert({typeName, reinterpret_cast<IComponentArray *>(new ComponentArray<T>())});
+  // Component storage growing in fixed-size pages of raw, aligned memory.
+  // Elements are constructed and destroyed explicitly, so T needn't be default
+  // constructible and a removed element releases its resources right away.
+  // Elements never move when the array grows, so references into a page stay
+  // valid until that element is removed. Trailing pages are released once
+  // they run empty, keeping one spare page around so that adding and removing
+  // at a page boundary doesn't allocate every time.
+  template<typename T>
+  class PagedArray
+  {
+  public:
+    static constexpr size_t PAGE_SIZE = 1024;
 
-      ++mNextComponentType;
-    }
+    inline PagedArray() = default;
+    PagedArray(const PagedArray&) = delete;
+    PagedArray& operator=(const PagedArray&) = delete;
 
-    template<typename T>
-    inline ComponentType getComponentType()
+    // Frees the pages without destroying elements, the owner has to destroy
+    // the elements it constructed
+    inline ~PagedArray()
     {
-      const char* typeName = typeid(T).name();
-
-      if (mComponentTypes.find(typeName) == mComponentTypes.end())
+      shrink(0);
+      if (!mPages.empty())
       {
-        LOG_ERROR("Tried to access unregistered component!");
-        assert(false);
+        freePage(mPages.back());
       }
+    }
 
-      return mComponentTypes[typeName];
+    inline T& operator[](size_t index)
+    {
+      return mPages[index / PAGE_SIZE][index % PAGE_SIZE];
     }
 
-    template<typename T>
-    inline void addComponent(Entity entity, T component)
+    inline const T& operator[](size_t index) const
     {
-      getComponentArray<T>()->insertData(entity, component);
+      return mPages[index / PAGE_SIZE][index % PAGE_SIZE];
     }
 
-    template<typename T>
-    inline void removeComponent(Entity entity)
+    template<typename... Args>
+    inline T& construct(size_t index, Args&&... args)
     {
-      getComponentArray<T>()->removeData(entity);
+      return *new (&mPages[index / PAGE_SIZE][index % PAGE_SIZE]) T(std::forward<Args>(args)...);
     }
 
-    template<typename T>
-    inline T& getComponent(Entity entity)
+    inline void destroy(size_t index)
     {
-      return getComponentArray<T>()->getData(entity);
+      (*this)[index].~T();
     }
 
-    inline void entityDestroyed(Entity entity)
+    // Makes sure the pages for indices [0, size) exist
+    inline void reserve(size_t size)
     {
-      for(auto const& pair : mComponentArrays)
+      size_t pages = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+      while (mPages.size() < pages)
       {
-        auto const& component = pair.second;
-        component->entityDestroyed(entity);
+        mPages.push_back(static_cast<T*>(::operator new(PAGE_SIZE * sizeof(T), std::align_val_t(alignof(T)))));
       }
     }
 
-    inline ~ComponentManager()
+    // Releases pages not needed for indices [0, size), but one
+    inline void shrink(size_t size)
     {
-      for (auto const& pair : mComponentArrays)
+      size_t pages = (size + PAGE_SIZE - 1) / PAGE_SIZE + 1;
+      while (mPages.size() > pages)
       {
-        delete pair.second;
+        freePage(mPages.back());
+        mPages.pop_back();
       }
     }
-  public:
-    absl::flat_hash_map<const char*, ComponentType> mComponentTypes{};
 
-    absl::flat_hash_map<const char*, IComponentArray*> mComponentArrays{};
-
-    ComponentType mNextComponentType{};
-
-    template<typename T>
-    ComponentArray<T>* getComponentArray()
+    inline size_t capacity() const
     {
-      const char* typeName = typeid(T).name();
+      return mPages.size() * PAGE_SIZE;
+    }
 
-      if(mComponentTypes.find(typeName) == mComponentTypes.end())
-      {
-        LOG_ERROR("Tried to use unregistered component!");
-        assert(false);
-      }
+  public:
+    std::vector<T*> mPages{};
 
-      // return static_cast<ComponentArray<T>*>(mComponentArrays[typeName]);
-      // ComponentArray<T>* temp = mComponentArrays[typeName];
-      // return temp;
-      return reinterpret_cast<ComponentArray<T>*>(mComponentArrays[typeName]);
+  private:
+    inline static void freePage(T* page)
+    {
+      ::operator delete(page, std::align_val_t(alignof(T)));
     }
   };
 
-  class EntityManager
+  // Type-erased description of a component type. Native types get theirs from
+  // getComponentInfo<T>(), component types defined at runtime (e.g. by
+  // scripts) are registered from one. Null functions stand for trivial
+  // operations: memcpy for copy, nothing for destroy. Without moveConstruct
+  // the type is relocated by memcpy, and the source isn't destroyed after.
+  // Registration rejects a zero size or an alignment that isn't a power of
+  // two. Storage lays elements out stride apart, size rounded up to a
+  // multiple of alignment like sizeof does; registration fills it in
+  struct ComponentInfo
   {
-  public:
-    inline EntityManager()
+    std::string name;
+    size_t size;
+    size_t alignment;
+    void (*copyConstruct)(void* dst, const void* src);
+    void (*moveConstruct)(void* dst, void* src);
+    void (*destroy)(void* ptr);
+    size_t stride = 0;
+
+    inline void copy(void* dst, const void* src) const
     {
-      for (Entity e = 0; e < MAX_ENTITIES; e++)
-      {
-        mAvailableEntities.push(e);
-      }
+      copyConstruct ? copyConstruct(dst, src) : void(std::memcpy(dst, src, size));
     }
 
-    inline Entity createEntity()
+    // Moves src to dst and ends the lifetime of src
+    inline void relocate(void* dst, void* src) const
     {
-      if (mLivingEntityCount >= MAX_ENTITIES)
+      if (moveConstruct)
       {
-        LOG_ERROR("Tried to create new entity, when no more entities are available");
-        assert(false);
+        moveConstruct(dst, src);
+        destruct(src);
+      }
+      else
+      {
+        std::memcpy(dst, src, size);
       }
-      Entity id = mAvailableEntities.front();
-      mAvailableEntities.pop();
-      ++mLivingEntityCount;
-      mExistingEntities.insert(id);
-      return id;
     }
 
-    inline void destroyEntity(Entity entity)
+    inline void destruct(void* ptr) const
     {
-      if (entity >= MAX_ENTITIES)
+      if (destroy)
       {
-        LOG_ERROR("Tried to delete out-of-range entity - deleting nothing");
-        return;
+        destroy(ptr);
       }
+    }
+  };
 
-      mSignatures[entity].reset();
-      mExistingEntities.erase(entity);
+  // Whether components of type T can be copied, e.g. by instantiate. Types
+  // whose copy constructor is declared but ill-formed, like one holding a
+  // std::vector<std::unique_ptr<U>>, still pass is_copy_constructible. Declare
+  // them through ECS_MOVE_ONLY_COMPONENT(Type) at global scope, copying them
+  // is then refused at runtime instead of failing to compile
+  template<typename T>
+  constexpr bool isCopyableComponent = std::is_copy_constructible_v<T>;
 
-      // May want to add check if entity is alive
-      mAvailableEntities.push(entity);
-      --mLivingEntityCount;
+  #define ECS_MOVE_ONLY_COMPONENT(Type) \
+    namespace ecs \
+    { \
+      template<> \
+      constexpr bool isCopyableComponent<Type> = false; \
     }
 
-    inline void setSignature(Entity entity, Signature signature)
-    {
-      if (entity >= MAX_ENTITIES)
-      {
-        LOG_ERROR("Tried to change signature of out-of-range entity - changing nothing");
-        return;
-      }
+  template<typename T>
+  inline const ComponentInfo* getComponentInfo()
+  {
+    using CopyFunction = void (*)(void*, const void*);
+    using MoveFunction = void (*)(void*, void*);
+    using DestroyFunction = void (*)(void*);
+
+    static const ComponentInfo info {
+      typeid(T).name(),
+      sizeof(T),
+      alignof(T),
+      [] {
+        if constexpr (std::is_trivially_copyable_v<T>)
+        {
+          return CopyFunction{};
+        }
+        else if constexpr (isCopyableComponent<T>)
+        {
+          return CopyFunction{ [](void* dst, const void* src) { new (dst) T(*static_cast<const T*>(src)); } };
+        }
+        else
+        {
+          return CopyFunction{ [](void*, const void*)
+          {
+            LOG_ERROR("Tried copying a component that isn't copy constructible");
+            assert(false);
+          } };
+        }
+      }(),
+      [] {
+        if constexpr (std::is_trivially_copyable_v<T>)
+        {
+          return MoveFunction{};
+        }
+        else
+        {
+          return MoveFunction{ [](void* dst, void* src) { new (dst) T(std::move(*static_cast<T*>(src))); } };
+        }
+      }(),
+      [] {
+        if constexpr (std::is_trivially_destructible_v<T>)
+        {
+          return DestroyFunction{};
+        }
+        else
+        {
+          return DestroyFunction{ [](void* ptr) { static_cast<T*>(ptr)->~T(); } };
+        }
+      }(),
+      sizeof(T)
+    };
+    return &info;
+  }
+
+  class IComponentArray
+  {
+  public:
+    virtual ~IComponentArray() = default;
+    virtual void entityDestroyed(Entity entity) = 0;
+    virtual void copyData(Entity source, const EntityRange& entities) = 0;
 
-      mSignatures[entity] = signature;
+    virtual bool isCopyable() const
+    {
+      return true;
     }
 
-    inline Signature getSignature(Entity entity)
+    virtual void entitiesDestroyed(const std::vector<Entity>& entities)
     {
-      if (entity >= MAX_ENTITIES)
+      for (Entity entity : entities)
       {
-        LOG_ERROR("Tried to get signature of out-of-range entity");
-        assert(true);
+        entityDestroyed(entity);
       }
-      return mSignatures[entity];
     }
-
-  public:
-    std::queue<Entity> mAvailableEntities {}; // Unused entity ID's
-    std::set<Entity> mExistingEntities {}; // Uesd entity ID's
-    std::array<Signature, MAX_ENTITIES> mSignatures {}; // Signatures corresponding to Entities
-    uint32_t mLivingEntityCount {};
   };
 
-  class System
+  template<typename T>
+  class ComponentArray : IComponentArray
   {
   public:
-    std::set<Entity> mEntities;
+    PagedArray<T> mComponentArray{};
 
-    virtual void entityRegistered(Entity entity)
-    {
+    SparseSet mEntities{};
 
-    }
+  public:
+    inline ComponentArray() = default;
+    ComponentArray(const ComponentArray&) = delete;
+    ComponentArray& operator=(const ComponentArray&) = delete;
 
-    virtual void entityErased(Entity entity)
+    inline ~ComponentArray() override
     {
-
+      for (size_t i = 0; i < mEntities.size(); i++)
+      {
+        mComponentArray.destroy(i);
+      }
     }
-  };
 
-  class SystemManager
-  {
-  public:
-    template<typename T, typename... Args>
-    inline T* registerSystem(Args... args)
+    inline void insertData(Entity entity, T component)
     {
-      const char* typeName = typeid(T).name();
+      emplaceData(entity, std::move(component));
+    }
 
-      if (mSystems.find(typeName) != mSystems.end())
+    template<typename... Args>
+    inline void emplaceData(Entity entity, Args&&... args)
+    {
+      if (mEntities.contains(entity))
       {
-        LOG_ERROR("Tried registering a system multiple times!");
-        assert(false);
+        LOG_ERROR("Tried adding same component to entity multiple times - adding nothing");
+        return;
+      }
+      if (mEntities.holds(entity))
+      {
+        LOG_ERROR("Tried adding component to stale entity - adding nothing");
+        return;
       }
 
-      T* system = new T(args...);
-      mSystems.insert({typeName, (System*)(system)}); // ? delete cast
-      return system;
+      mComponentArray.reserve(mEntities.size() + 1);
+      mComponentArray.construct(mEntities.size(), std::forward<Args>(args)...);
+      mEntities.insert(entity);
     }
 
-    template<typename T>
-    inline void setSignature(Signature signature)
+    inline void removeData(Entity entity)
     {
-      const char* typeName = typeid(T).name();
-      if (mSystems.find(typeName) == mSystems.end())
+      if (!mEntities.contains(entity))
       {
-        LOG_ERROR("Tried setting Signature for unregistered System - setting nothing");
+        LOG_ERROR("Tried removing non-existent entity - removing nothing");
         return;
       }
 
-      mSignatures.insert({typeName, signature});
+      size_t indexOfLastElement = mEntities.size() - 1;
+      size_t indexOfRemovedEntity = mEntities.erase(entity);
+      mComponentArray.destroy(indexOfRemovedEntity);
+      if (indexOfRemovedEntity != indexOfLastElement)
+      {
+        mComponentArray.construct(indexOfRemovedEntity, std::move(mComponentArray[indexOfLastElement]));
+        mComponentArray.destroy(indexOfLastElement);
+      }
+      mComponentArray.shrink(indexOfLastElement);
     }
 
-    inline void entityDestroyed(Entity entity)
+    inline T& getData(Entity entity)
     {
-      for (auto const& pair : mSystems)
+      if (!mEntities.contains(entity))
       {
-        auto const& system = pair.second;
-
-        system->mEntities.erase(entity);
+        LOG_ERROR("Tried to retrieve data of non-existent entity");
+        assert(false);
       }
+
+      return mComponentArray[mEntities.index(entity)];
     }
 
-    inline void entitySignatureChanged(Entity entity, Signature signature)
+    inline size_t size() const
     {
-      for (auto const& pair : mSystems)
-      {
-        auto const& type = pair.first;
-        auto const& system = pair.second;
-        auto const& systemSignature = mSignatures[type];
+      return mEntities.size();
+    }
 
-        if ((signature & systemSignature) == systemSignature)
-        {
-          system->mEntities.insert(entity);
-          system->entityRegistered(entity);
-        }
-        else
+    // Adds a copy of source's component to each of entities
+    inline void copyData(Entity source, const EntityRange& entities) override
+    {
+      if constexpr (isCopyableComponent<T>)
+      {
+        const T& component = getData(source);
+        mComponentArray.reserve(mEntities.size() + entities.size());
+        for (Entity entity : entities)
         {
-          system->mEntities.erase(entity);
-          system->entityErased(entity);
+          emplaceData(entity, component);
         }
       }
-    }
-
-    inline ~SystemManager()
-    {
-      for (auto const& pair : mSystems)
+      else
       {
-        delete pair.second;
+        LOG_ERROR("Tried to copy component that isn't copy constructible - copying nothing");
       }
     }
+
+    inline bool isCopyable() const override
+    {
+      return isCopyableComponent<T>;
+    }
+
+    inline void entityDestroyed(Entity entity) override
+    {
+      if (mEntities.contains(entity))
+      {
+        removeData(entity);
+      }
+    }
+
+    inline void entitiesDestroyed(const std::vector<Entity>& entities) override
+    {
+      for (Entity entity : mEntities.highestFirst(entities))
+      {
+        removeData(entity);
+      }
+    }
+  };
+
+  // Storage for component types defined at runtime. Laid out like
+  // ComponentArray, with the element size and operations taken from the
+  // type's ComponentInfo
+  class RuntimeComponentArray : IComponentArray
+  {
   public:
-    absl::flat_hash_map<const char*, Signature> mSignatures{};
-    absl::flat_hash_map<const char*, System*> mSystems{};
+    static constexpr size_t PAGE_SIZE = 1024;
+
+    const ComponentInfo mInfo;
+
+    std::vector<std::byte*> mPages{};
+
+    SparseSet mEntities{};
+
+  public:
+    inline RuntimeComponentArray(const ComponentInfo& info)
+      : mInfo(info)
+    {}
+
+    RuntimeComponentArray(const RuntimeComponentArray&) = delete;
+    RuntimeComponentArray& operator=(const RuntimeComponentArray&) = delete;
+
+    inline ~RuntimeComponentArray() override
+    {
+      for (size_t i = 0; i < mEntities.size(); i++)
+      {
+        mInfo.destruct(get(i));
+      }
+      for (std::byte* page : mPages)
+      {
+        ::operator delete(page, std::align_val_t(mInfo.alignment));
+      }
+    }
+
+    // Returns uninitialized memory for the entity's new component, which the
+    // caller has to construct
+    inline void* insertData(Entity entity)
+    {
+      if (mEntities.contains(entity))
+      {
+        LOG_ERROR("Tried adding same component to entity multiple times - adding nothing");
+        return nullptr;
+      }
+      if (mEntities.holds(entity))
+      {
+        LOG_ERROR("Tried adding component to stale entity - adding nothing");
+        return nullptr;
+      }
+
+      if (mEntities.size() == mPages.size() * PAGE_SIZE)
+      {
+        mPages.push_back(static_cast<std::byte*>(::operator new(PAGE_SIZE * mInfo.stride, std::align_val_t(mInfo.alignment))));
+      }
+      return get(mEntities.insert(entity));
+    }
+
+    inline void removeData(Entity entity)
+    {
+      if (!mEntities.contains(entity))
+      {
+        LOG_ERROR("Tried removing non-existent entity - removing nothing");
+        return;
+      }
+
+      size_t indexOfLastElement = mEntities.size() - 1;
+      size_t indexOfRemovedEntity = mEntities.erase(entity);
+      mInfo.destruct(get(indexOfRemovedEntity));
+      if (indexOfRemovedEntity != indexOfLastElement)
+      {
+        mInfo.relocate(get(indexOfRemovedEntity), get(indexOfLastElement));
+      }
+
+      // Release trailing pages, keeping one spare
+      size_t pages = (indexOfLastElement + PAGE_SIZE - 1) / PAGE_SIZE + 1;
+      while (mPages.size() > pages)
+      {
+        ::operator delete(mPages.back(), std::align_val_t(mInfo.alignment));
+        mPages.pop_back();
+      }
+    }
+
+    inline void* getData(Entity entity)
+    {
+      if (!mEntities.contains(entity))
+      {
+        LOG_ERROR("Tried to retrieve data of non-existent entity");
+        assert(false);
+      }
+
+      return get(mEntities.index(entity));
+    }
+
+    inline size_t size() const
+    {
+      return mEntities.size();
+    }
+
+    inline void copyData(Entity source, const EntityRange& entities) override
+    {
+      const void* component = getData(source);
+      for (Entity entity : entities)
+      {
+        if (void* copy = insertData(entity))
+        {
+          mInfo.copy(copy, component);
+        }
+      }
+    }
+
+    inline void entityDestroyed(Entity entity) override
+    {
+      if (mEntities.contains(entity))
+      {
+        removeData(entity);
+      }
+    }
+
+    inline void entitiesDestroyed(const std::vector<Entity>& entities) override
+    {
+      for (Entity entity : mEntities.highestFirst(entities))
+      {
+        removeData(entity);
+      }
+    }
+
+  private:
+    inline void* get(size_t index)
+    {
+      return mPages[index / PAGE_SIZE] + (index % PAGE_SIZE) * mInfo.stride;
+    }
   };
 
-  class IResourceArray
+  // Opt-in struct-of-arrays layout. A component declared through
+  // ECS_SOA_COMPONENT is stored as one aligned column per field instead of an
+  // array of whole objects
+  template<typename T>
+  struct SoaLayout
   {
+    static constexpr bool enabled = false;
+  };
+
+  template<typename T>
+  constexpr bool isSoaComponent = SoaLayout<T>::enabled;
+
+  template<typename T>
+  struct MemberType;
 
+  template<typename C, typename M>
+  struct MemberType<M C::*>
+  {
+    using type = M;
   };
 
-  template <typename T>
-  class ResourceArray : IResourceArray
+  #define ECS_PARENS ()
+  #define ECS_EXPAND(...) ECS_EXPAND3(ECS_EXPAND3(ECS_EXPAND3(ECS_EXPAND3(__VA_ARGS__))))
+  #define ECS_EXPAND3(...) ECS_EXPAND2(ECS_EXPAND2(ECS_EXPAND2(ECS_EXPAND2(__VA_ARGS__))))
+  #define ECS_EXPAND2(...) ECS_EXPAND1(ECS_EXPAND1(ECS_EXPAND1(ECS_EXPAND1(__VA_ARGS__))))
+  #define ECS_EXPAND1(...) __VA_ARGS__
+  #define ECS_FOR_EACH(macro, type, ...) __VA_OPT__(ECS_EXPAND(ECS_FOR_EACH_HELPER(macro, type, __VA_ARGS__)))
+  #define ECS_FOR_EACH_HELPER(macro, type, field, ...) macro(type, field) __VA_OPT__(ECS_FOR_EACH_AGAIN ECS_PARENS (macro, type, __VA_ARGS__))
+  #define ECS_FOR_EACH_AGAIN() ECS_FOR_EACH_HELPER
+
+  #define ECS_SOA_FIELD_POINTER(type, field) , std::make_tuple(&type::field)
+  #define ECS_SOA_VIEW_COLUMN(type, field) decltype(type::field)* field;
+
+  // Declares the fields of a component to be stored as separate columns, e.g.
+  // ECS_SOA_COMPONENT(Position, x, y, z). Has to be used at global scope. The
+  // resulting SoaLayout<Position>::View reads like view.x[i]
+  #define ECS_SOA_COMPONENT(Type, ...) \
+    namespace ecs \
+    { \
+      template<> \
+      struct SoaLayout<Type> \
+      { \
+        static constexpr bool enabled = true; \
+        static constexpr auto fields = std::tuple_cat(std::tuple<>() ECS_FOR_EACH(ECS_SOA_FIELD_POINTER, Type, __VA_ARGS__)); \
+        struct View \
+        { \
+          ECS_FOR_EACH(ECS_SOA_VIEW_COLUMN, Type, __VA_ARGS__) \
+          size_t size; \
+          const Entity* entities; \
+        }; \
+      }; \
+    }
+
+  template<typename T>
+  class SoaComponentArray : IComponentArray
   {
   public:
-    inline T*& getResource(const char* key)
+    using Layout = SoaLayout<T>;
+    static constexpr size_t FIELD_COUNT = std::tuple_size_v<std::remove_const_t<decltype(Layout::fields)>>;
+    static constexpr size_t COLUMN_ALIGNMENT = 64;
+
+    template<size_t I>
+    using FieldType = typename MemberType<std::tuple_element_t<I, std::remove_const_t<decltype(Layout::fields)>>>::type;
+
+    std::array<std::byte*, FIELD_COUNT> mColumns{};
+
+    SparseSet mEntities{};
+
+    size_t mCapacity{};
+
+  public:
+    inline SoaComponentArray() = default;
+    SoaComponentArray(const SoaComponentArray&) = delete;
+    SoaComponentArray& operator=(const SoaComponentArray&) = delete;
+
+    inline ~SoaComponentArray() override
     {
-      absl::string_view view = key;
-      return data[view];
+      for (std::byte* column : mColumns)
+      {
+        ::operator delete(column, std::align_val_t(COLUMN_ALIGNMENT));
+      }
     }
-    inline T*& getResource(std::string key)
+
+    template<typename... Args>
+    inline void emplaceData(Entity entity, Args&&... args)
     {
-      return getResource(key.c_str());
+      insertData(entity, T(std::forward<Args>(args)...));
     }
 
-    inline void setResource(const char* key, T* value)
+    inline void insertData(Entity entity, const T& component)
     {
-      absl::string_view view = key;
-      data[view] = value;
+      if (mEntities.contains(entity))
+      {
+        LOG_ERROR("Tried adding same component to entity multiple times - adding nothing");
+        return;
+      }
+      if (mEntities.holds(entity))
+      {
+        LOG_ERROR("Tried adding component to stale entity - adding nothing");
+        return;
+      }
+
+      if (mEntities.size() == mCapacity)
+      {
+        grow(mCapacity ? mCapacity * 2 : 64, std::make_index_sequence<FIELD_COUNT>{});
+      }
+      size_t newIndex = mEntities.insert(entity);
+      scatter(newIndex, component, std::make_index_sequence<FIELD_COUNT>{});
     }
-    inline void setResource(std::string key, T* value)
+
+    inline void removeData(Entity entity)
     {
-      setResource(key.c_str(), value);
+      if (!mEntities.contains(entity))
+      {
+        LOG_ERROR("Tried removing non-existent entity - removing nothing");
+        return;
+      }
+
+      size_t indexOfLastElement = mEntities.size() - 1;
+      size_t indexOfRemovedEntity = mEntities.erase(entity);
+      moveField(indexOfLastElement, indexOfRemovedEntity, std::make_index_sequence<FIELD_COUNT>{});
     }
 
-    inline void deleteResource(const char* key)
+    // Gathers the fields of entity's component into a copy
+    inline T getData(Entity entity)
     {
-      absl::string_view view = key;
-      // delete data[view];
-      data.erase(view);
+      if (!mEntities.contains(entity))
+      {
+        LOG_ERROR("Tried to retrieve data of non-existent entity");
+        assert(false);
+      }
+
+      T component{};
+      gather(mEntities.index(entity), component, std::make_index_sequence<FIELD_COUNT>{});
+      return component;
     }
-    inline void deleteResource(std::string key)
+
+    // Scatters component over the fields of entity's existing component
+    inline void setData(Entity entity, const T& component)
     {
-      deleteResource(key.c_str());
+      if (!mEntities.contains(entity))
+      {
+        LOG_ERROR("Tried to set data of non-existent entity - setting nothing");
+        return;
+      }
+
+      scatter(mEntities.index(entity), component, std::make_index_sequence<FIELD_COUNT>{});
     }
 
-    inline void deleteAll()
+    inline typename Layout::View getView()
     {
-      // for (auto& d : data)
-      // {
-      //   // T*& temp;
-      //   if(d.second) delete d.second;
-      //   // absl::string_view view = d.first;
-      //   // data.erase(view);
-      //   // delete temp;
-      // }
-      data.clear();
+      return getView(std::make_index_sequence<FIELD_COUNT>{});
     }
 
-    inline T*& operator[](const char* key)
+    inline size_t size() const
     {
-      absl::string_view view = key;
-      return data[view];
+      return mEntities.size();
     }
-    inline T*& operator[](std::string key)
+
+    inline void copyData(Entity source, const EntityRange& entities) override
     {
-      return this[key.c_str()];
+      T component = getData(source);
+      for (Entity entity : entities)
+      {
+        insertData(entity, component);
+      }
+    }
+
+    inline void entityDestroyed(Entity entity) override
+    {
+      if (mEntities.contains(entity))
+      {
+        removeData(entity);
+      }
+    }
+
+    inline void entitiesDestroyed(const std::vector<Entity>& entities) override
+    {
+      for (Entity entity : mEntities.highestFirst(entities))
+      {
+        removeData(entity);
+      }
     }
+
   private:
-    absl::flat_hash_map<std::string, T*> data;
+    template<size_t I>
+    inline FieldType<I>* getColumn()
+    {
+      return reinterpret_cast<FieldType<I>*>(mColumns[I]);
+    }
+
+    template<size_t... I>
+    inline void grow(size_t capacity, std::index_sequence<I...>)
+    {
+      (growColumn<I>(capacity), ...);
+      mCapacity = capacity;
+    }
+
+    template<size_t I>
+    inline void growColumn(size_t capacity)
+    {
+      static_assert(std::is_trivially_copyable_v<FieldType<I>>, "SoA component fields have to be trivially copyable");
+      std::byte* column = static_cast<std::byte*>(::operator new(capacity * sizeof(FieldType<I>), std::align_val_t(COLUMN_ALIGNMENT)));
+      if (mColumns[I])
+      {
+        std::memcpy(column, mColumns[I], mEntities.size() * sizeof(FieldType<I>));
+        ::operator delete(mColumns[I], std::align_val_t(COLUMN_ALIGNMENT));
+      }
+      mColumns[I] = column;
+    }
+
+    template<size_t... I>
+    inline void scatter(size_t index, const T& component, std::index_sequence<I...>)
+    {
+      ((getColumn<I>()[index] = component.*std::get<I>(Layout::fields)), ...);
+    }
+
+    template<size_t... I>
+    inline void gather(size_t index, T& component, std::index_sequence<I...>)
+    {
+      ((component.*std::get<I>(Layout::fields) = getColumn<I>()[index]), ...);
+    }
+
+    template<size_t... I>
+    inline void moveField(size_t from, size_t to, std::index_sequence<I...>)
+    {
+      ((getColumn<I>()[to] = getColumn<I>()[from]), ...);
+    }
+
+    template<size_t... I>
+    inline typename Layout::View getView(std::index_sequence<I...>)
+    {
+      return typename Layout::View{ getColumn<I>()..., mEntities.size(), mEntities.entities().data() };
+    }
   };
 
-  class ResourceManager
+  // Empty types are tag components: whether an entity has one is recorded by
+  // its signature bit alone, without any per-entity storage
+  template<typename T>
+  constexpr bool isTagComponent = std::is_empty_v<T>;
+
+  // The one object handed out for every entity carrying the tag T
+  template<typename T>
+  inline T& getTagInstance()
+  {
+    static T instance{};
+    return instance;
+  }
+
+  template<typename T>
+  class TagComponentArray : IComponentArray
   {
   public:
-    template<typename T>
-    inline void registerResourceType()
+    template<typename... Args>
+    inline void emplaceData(Entity, Args&&...)
     {
-      const char* name = typeid(T).name();
-      if (resourceArrays.find(name) != resourceArrays.end())
-      {
-        LOG_ERROR("Tried to register resource multiple times - registering nothing");
-        return;
-      }
-      resourceArrays.insert({name, reinterpret_cast<IResourceArray*>(new ResourceArray<T>())});
-      // resourceArrays[name] = reinterpret_cast<IResourceArray*>(new ResourceArray<T>());
+    }
+
+    inline void insertData(Entity, T)
+    {
+    }
+
+    inline void removeData(Entity)
+    {
+    }
+
+    inline T& getData(Entity)
+    {
+      return getTagInstance<T>();
+    }
+
+    inline void copyData(Entity, const EntityRange&) override
+    {
+    }
+
+    inline void entityDestroyed(Entity) override
+    {
+    }
+  };
+
+  // Shared components are stored once per distinct value and referenced by
+  // every entity carrying that value. Declare them through
+  // ECS_SHARED_COMPONENT(Type) at global scope. Values need operator== and
+  // have to be hashable by absl::Hash
+  template<typename T>
+  constexpr bool isSharedComponent = false;
+
+  #define ECS_SHARED_COMPONENT(Type) \
+    namespace ecs \
+    { \
+      template<> \
+      constexpr bool isSharedComponent<Type> = true; \
+    }
+
+  // Whether archetype storage keeps T in a chunk column. Tags need no storage,
+  // shared components stay in their SharedComponentArray in either storage mode
+  template<typename T>
+  constexpr bool hasArchetypeColumn = !isTagComponent<T> && !isSharedComponent<T>;
+
+  template<typename T>
+  class SharedComponentArray : IComponentArray
+  {
+  public:
+    // One distinct value and every entity referencing it
+    struct Group
+    {
+      T value;
+      std::vector<Entity> entities;
+    };
+
+    struct Membership
+    {
+      Group* group;
+      uint32_t position; // Index of the entity in group->entities
+    };
+
+    // Lets mGroups be searched by value without a second copy of it
+    struct GroupHash
+    {
+      using is_transparent = void;
+
+      inline size_t operator()(const Group* group) const { return absl::Hash<T>{}(group->value); }
+      inline size_t operator()(const T& value) const { return absl::Hash<T>{}(value); }
+    };
+
+    struct GroupEq
+    {
+      using is_transparent = void;
+
+      inline bool operator()(const Group* a, const Group* b) const { return a->value == b->value; }
+      inline bool operator()(const Group* a, const T& b) const { return a->value == b; }
+      inline bool operator()(const T& a, const Group* b) const { return a == b->value; }
+    };
+
+    absl::flat_hash_set<Group*, GroupHash, GroupEq> mGroups{};
+
+    SparseSet mEntities{};
+
+    std::vector<Membership> mMemberships{}; // Parallel to mEntities' dense side
+
+  public:
+    inline SharedComponentArray() = default;
+    SharedComponentArray(const SharedComponentArray&) = delete;
+    SharedComponentArray& operator=(const SharedComponentArray&) = delete;
+
+    inline ~SharedComponentArray() override
+    {
+      for (Group* group : mGroups)
+      {
+        delete group;
+      }
+    }
+
+    template<typename... Args>
+    inline void emplaceData(Entity entity, Args&&... args)
+    {
+      insertData(entity, T(std::forward<Args>(args)...));
+    }
+
+    inline void insertData(Entity entity, T component)
+    {
+      if (mEntities.contains(entity))
+      {
+        LOG_ERROR("Tried adding same component to entity multiple times - adding nothing");
+        return;
+      }
+      if (mEntities.holds(entity))
+      {
+        LOG_ERROR("Tried adding component to stale entity - adding nothing");
+        return;
+      }
+
+      Group* group;
+      auto it = mGroups.find(component);
+      if (it != mGroups.end())
+      {
+        group = *it;
+      }
+      else
+      {
+        group = new Group{ std::move(component), {} };
+        mGroups.insert(group);
+      }
+
+      join(entity, group);
+    }
+
+    inline void removeData(Entity entity)
+    {
+      if (!mEntities.contains(entity))
+      {
+        LOG_ERROR("Tried removing non-existent entity - removing nothing");
+        return;
+      }
+
+      Membership membership = mMemberships[mEntities.index(entity)];
+      Group* group = membership.group;
+      Entity entityOfLastMember = group->entities.back();
+      group->entities[membership.position] = entityOfLastMember;
+      mMemberships[mEntities.index(entityOfLastMember)].position = membership.position;
+      group->entities.pop_back();
+
+      if (group->entities.empty())
+      {
+        mGroups.erase(group);
+        delete group;
+      }
+
+      size_t indexOfLastElement = mEntities.size() - 1;
+      size_t indexOfRemovedEntity = mEntities.erase(entity);
+      mMemberships[indexOfRemovedEntity] = mMemberships[indexOfLastElement];
+      mMemberships.pop_back();
+    }
+
+    // Shared values can't be modified through one entity, give it a new value
+    // by removing and re-adding the component instead
+    inline const T& getData(Entity entity)
+    {
+      if (!mEntities.contains(entity))
+      {
+        LOG_ERROR("Tried to retrieve data of non-existent entity");
+        assert(false);
+      }
+
+      return mMemberships[mEntities.index(entity)].group->value;
+    }
+
+    // Calls func(value, entities) once per distinct value
+    template<typename F>
+    inline void forEachGroup(F&& func)
+    {
+      for (const Group* group : mGroups)
+      {
+        func(static_cast<const T&>(group->value), static_cast<const std::vector<Entity>&>(group->entities));
+      }
+    }
+
+    inline size_t size() const
+    {
+      return mEntities.size();
+    }
+
+  private:
+    inline void join(Entity entity, Group* group)
+    {
+      mMemberships.push_back({ group, static_cast<uint32_t>(group->entities.size()) });
+      group->entities.push_back(entity);
+      mEntities.insert(entity);
+    }
+
+  public:
+    // Adds entities to the group of source, without hashing its value again
+    inline void copyData(Entity source, const EntityRange& entities) override
+    {
+      if (!mEntities.contains(source))
+      {
+        LOG_ERROR("Tried to copy data of non-existent entity - copying nothing");
+        return;
+      }
+
+      Group* group = mMemberships[mEntities.index(source)].group;
+      for (Entity entity : entities)
+      {
+        if (mEntities.contains(entity))
+        {
+          LOG_ERROR("Tried adding same component to entity multiple times - adding nothing");
+          continue;
+        }
+        join(entity, group);
+      }
+    }
+
+    inline void entityDestroyed(Entity entity) override
+    {
+      if (mEntities.contains(entity))
+      {
+        removeData(entity);
+      }
+    }
+  };
+
+  // Built-in tag marking prefabs, entities serving as templates for
+  // Coordinator::instantiate. Every world registers it first, so its
+  // component type is always PREFAB_TYPE. Systems and queries skip prefabs
+  // unless they ask for Prefab themselves
+  struct Prefab {};
+
+  constexpr ComponentType PREFAB_TYPE = 0;
+
+  // Storage used by the ComponentManager for components of type T
+  template<typename T>
+  using ComponentArrayType = std::conditional_t<isTagComponent<T>, TagComponentArray<T>,
+    std::conditional_t<isSharedComponent<T>, SharedComponentArray<T>,
+    std::conditional_t<isSoaComponent<T>, SoaComponentArray<T>, ComponentArray<T>>>>;
+
+  // Component types are identified by their TypeIndex<IComponentArray>, which
+  // is assigned once per type. Each world maps that index to its own
+  // ComponentType (the signature bit) and component array, so finding a type's
+  // array is a single indexed load
+  class ComponentManager
+  {
+  public:
+    static constexpr ComponentType UNREGISTERED = UINT32_MAX;
+
+    inline ComponentManager(ComponentType maxComponents)
+      : mMaxComponents(maxComponents)
+    {}
+
+    template<typename T>
+    inline void registerComponent()
+    {
+      size_t index = registerType<T>();
+      if (index != SIZE_MAX)
+      {
+        mComponentArrays[index] = reinterpret_cast<IComponentArray *>(new ComponentArrayType<T>());
+        setArray(mComponentTypes[index], mComponentArrays[index]);
+      }
+    }
+
+    // Singletons get a component type so systems can require them in their
+    // signature, but no component array
+    template<typename T>
+    inline void registerSingleton()
+    {
+      registerType<T>();
+    }
+
+    // Relations get a component type too, their pairs are kept in the
+    // Coordinator's RelationArrays. Returns false if T couldn't be registered
+    template<typename T>
+    inline bool registerRelation()
+    {
+      return registerType<T>() != SIZE_MAX;
+    }
+
+    template<typename T>
+    inline ComponentType getComponentType()
+    {
+      size_t index = TypeIndex<IComponentArray>::get<T>();
+
+      if (index >= mComponentTypes.size() || mComponentTypes[index] == UNREGISTERED)
+      {
+        LOG_ERROR("Tried to access unregistered component!");
+        assert(false);
+      }
+
+      return mComponentTypes[index];
+    }
+
+    // Registers a component type defined at runtime and returns its type, or
+    // UNREGISTERED if info is invalid or a type of the same name exists
+    // already
+    inline ComponentType registerComponent(const ComponentInfo& info)
+    {
+      if (info.size == 0 || info.alignment == 0 || (info.alignment & (info.alignment - 1)) != 0)
+      {
+        LOG_ERROR("Tried to register component type with invalid size or alignment - not registering anything");
+        return UNREGISTERED;
+      }
+      if (mRuntimeTypes.find(info.name) != mRuntimeTypes.end())
+      {
+        LOG_ERROR("Tried to register already registered component type - not registering anything");
+        return UNREGISTERED;
+      }
+      if (mNextComponentType >= mMaxComponents)
+      {
+        LOG_ERROR("Tried to register more component types than the world allows - not registering anything");
+        return UNREGISTERED;
+      }
+
+      ComponentType type = mNextComponentType;
+      mRuntimeTypes.insert({info.name, type});
+      mRuntimeArrays.resize(type + 1, nullptr);
+      ComponentInfo padded = info;
+      padded.stride = (info.size + info.alignment - 1) & ~(info.alignment - 1);
+      mRuntimeArrays[type] = new RuntimeComponentArray(padded);
+      setArray(type, reinterpret_cast<IComponentArray*>(mRuntimeArrays[type]));
+
+      ++mNextComponentType;
+      return type;
+    }
+
+    inline ComponentType getComponentType(const std::string& name)
+    {
+      auto it = mRuntimeTypes.find(name);
+      if (it == mRuntimeTypes.end())
+      {
+        LOG_ERROR("Tried to access unregistered component!");
+        assert(false);
+      }
+
+      return it->second;
+    }
+
+    inline void* addComponent(Entity entity, ComponentType type)
+    {
+      return getRuntimeArray(type)->insertData(entity);
+    }
+
+    inline void removeComponent(Entity entity, ComponentType type)
+    {
+      getRuntimeArray(type)->removeData(entity);
+    }
+
+    inline void* getComponent(Entity entity, ComponentType type)
+    {
+      return getRuntimeArray(type)->getData(entity);
+    }
+
+    template<typename T>
+    inline void addComponent(Entity entity, T component)
+    {
+      getComponentArray<T>()->insertData(entity, std::move(component));
+    }
+
+    template<typename T, typename... Args>
+    inline void emplaceComponent(Entity entity, Args&&... args)
+    {
+      getComponentArray<T>()->emplaceData(entity, std::forward<Args>(args)...);
+    }
+
+    template<typename T>
+    inline void removeComponent(Entity entity)
+    {
+      getComponentArray<T>()->removeData(entity);
+    }
+
+    // Returns a reference to the component, or a gathered copy for SoA components
+    template<typename T>
+    inline decltype(auto) getComponent(Entity entity)
+    {
+      return getComponentArray<T>()->getData(entity);
+    }
+
+    // Gives each of entities a copy of every component of source whose type
+    // is set in signature, one component type at a time
+    template<typename Signature>
+    inline void copyComponents(Entity source, const EntityRange& entities, const Signature& signature)
+    {
+      for (ComponentType type = 0; type < mArraysByType.size(); type++)
+      {
+        if (mArraysByType[type] && signature.test(type))
+        {
+          mArraysByType[type]->copyData(source, entities);
+        }
+      }
+    }
+
+    // Whether copyComponents can copy every component type set in signature
+    template<typename Signature>
+    inline bool isCopyable(const Signature& signature)
+    {
+      for (ComponentType type = 0; type < mArraysByType.size(); type++)
+      {
+        if (mArraysByType[type] && signature.test(type) && !mArraysByType[type]->isCopyable())
+        {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    // Only visits the arrays of the components in the entity's signature,
+    // walking its set bits instead of every registered type
+    template<typename Signature>
+    inline void entityDestroyed(Entity entity, const Signature& signature)
+    {
+      forEachSetBit(signature, [&](size_t type)
+      {
+        if (type < mArraysByType.size() && mArraysByType[type])
+        {
+          mArraysByType[type]->entityDestroyed(entity);
+        }
+      });
+    }
+
+    // Hands every array the entities owning its component in one batch.
+    // signatures[i] belongs to entities[i]. Entities are sorted into per-type
+    // batches by their set bits, so types no entity owns cost nothing
+    template<typename Signature>
+    inline void entitiesDestroyed(const std::vector<Entity>& entities, const std::vector<Signature>& signatures)
+    {
+      std::vector<std::vector<Entity>> owners(mArraysByType.size());
+      std::vector<ComponentType> owned{};
+      for (size_t i = 0; i < entities.size(); i++)
+      {
+        forEachSetBit(signatures[i], [&](size_t type)
+        {
+          if (type < mArraysByType.size() && mArraysByType[type])
+          {
+            if (owners[type].empty())
+            {
+              owned.push_back(static_cast<ComponentType>(type));
+            }
+            owners[type].push_back(entities[i]);
+          }
+        });
+      }
+
+      for (ComponentType type : owned)
+      {
+        mArraysByType[type]->entitiesDestroyed(owners[type]);
+      }
+    }
+
+    inline ~ComponentManager()
+    {
+      for (auto const& component : mComponentArrays)
+      {
+        delete component;
+      }
+      for (auto const& component : mRuntimeArrays)
+      {
+        delete component;
+      }
+    }
+  public:
+    std::vector<ComponentType> mComponentTypes{}; // Indexed by TypeIndex<IComponentArray>
+
+    std::vector<IComponentArray*> mComponentArrays{}; // Indexed by TypeIndex<IComponentArray>
+
+    absl::flat_hash_map<std::string, ComponentType> mRuntimeTypes{};
+
+    std::vector<RuntimeComponentArray*> mRuntimeArrays{}; // Indexed by ComponentType, nullptr for native types
+
+    std::vector<IComponentArray*> mArraysByType{}; // Indexed by ComponentType, nullptr for singletons and relations
+
+    ComponentType mNextComponentType{};
+
+    ComponentType mMaxComponents{};
+
+    inline RuntimeComponentArray* getRuntimeArray(ComponentType type)
+    {
+      if (type >= mRuntimeArrays.size() || !mRuntimeArrays[type])
+      {
+        LOG_ERROR("Tried to use unregistered component!");
+        assert(false);
+      }
+
+      return mRuntimeArrays[type];
+    }
+
+    template<typename T>
+    ComponentArrayType<T>* getComponentArray()
+    {
+      size_t index = TypeIndex<IComponentArray>::get<T>();
+
+      if (index >= mComponentArrays.size() || !mComponentArrays[index])
+      {
+        LOG_ERROR("Tried to use unregistered component!");
+        assert(false);
+      }
+
+      return reinterpret_cast<ComponentArrayType<T>*>(mComponentArrays[index]);
+    }
+
+  private:
+    inline void setArray(ComponentType type, IComponentArray* array)
+    {
+      if (type >= mArraysByType.size())
+      {
+        mArraysByType.resize(type + 1, nullptr);
+      }
+      mArraysByType[type] = array;
+    }
+
+    // Assigns T the next component type and returns its type index, or
+    // SIZE_MAX if T was already registered
+    template<typename T>
+    inline size_t registerType()
+    {
+      size_t index = TypeIndex<IComponentArray>::get<T>();
+      if (index >= mComponentTypes.size())
+      {
+        mComponentTypes.resize(index + 1, UNREGISTERED);
+        mComponentArrays.resize(index + 1, nullptr);
+      }
+
+      if (mComponentTypes[index] != UNREGISTERED)
+      {
+        LOG_ERROR("Tried to register already registered component type - not registering anything");
+        return SIZE_MAX;
+      }
+      if (mNextComponentType >= mMaxComponents)
+      {
+        LOG_ERROR("Tried to register more component types than the world allows - not registering anything");
+        return SIZE_MAX;
+      }
+
+      mComponentTypes[index] = mNextComponentType;
+
+      ++mNextComponentType;
+      return index;
+    }
+  };
+
+  // Fixed-size block of an archetype's rows. A chunk starts with the entities
+  // of its rows, followed by one column per component type, at the offsets
+  // laid out by the owning Archetype
+  struct ArchetypeChunk
+  {
+    std::byte* mData;
+    size_t mSize;
+
+    inline Entity* getEntities()
+    {
+      return reinterpret_cast<Entity*>(mData);
+    }
+  };
+
+  // Table holding every entity with exactly one signature. Rows are stored in
+  // chunks of CHUNK_SIZE bytes, so iterating an archetype walks it chunk by
+  // chunk with every column of the current chunk close together in cache
+  template<typename Config>
+  class Archetype
+  {
+  public:
+    using Signature = typename Config::Signature;
+
+    static constexpr size_t CHUNK_SIZE = 16 * 1024;
+    static constexpr size_t CHUNK_ALIGNMENT = 64;
+    static constexpr int32_t NO_COLUMN = -1;
+
+    inline Archetype(const Signature& signature, std::vector<ComponentType> types, std::vector<const ComponentInfo*> infos)
+      : mSignature(signature), mTypes(std::move(types)), mInfos(std::move(infos))
+    {
+      for (size_t i = 0; i < mTypes.size(); i++)
+      {
+        mColumnIndices.resize(mTypes[i] + 1, NO_COLUMN);
+        mColumnIndices[mTypes[i]] = static_cast<int32_t>(i);
+      }
+
+      size_t rowSize = sizeof(Entity);
+      for (auto const* info : mInfos)
+      {
+        rowSize += info->stride;
+        mChunkAlignment = std::max(mChunkAlignment, info->alignment);
+      }
+
+      // Start from the unpadded estimate and shrink until the aligned layout
+      // fits; a row wider than a chunk gets a chunk of its own
+      mChunkCapacity = std::max<size_t>(CHUNK_SIZE / rowSize, 1);
+      while (layoutChunk(mChunkCapacity) > CHUNK_SIZE && mChunkCapacity > 1)
+      {
+        --mChunkCapacity;
+      }
+      mChunkBytes = std::max(layoutChunk(mChunkCapacity), CHUNK_SIZE);
+    }
+
+    Archetype(const Archetype&) = delete;
+    Archetype& operator=(const Archetype&) = delete;
+
+    inline ~Archetype()
+    {
+      for (size_t row = 0; row < mSize; row++)
+      {
+        for (size_t column = 0; column < mInfos.size(); column++)
+        {
+          mInfos[column]->destruct(getComponent(column, row));
+        }
+      }
+      for (auto& chunk : mChunks)
+      {
+        ::operator delete(chunk.mData, std::align_val_t(mChunkAlignment));
+      }
+    }
+
+    inline int32_t getColumnIndex(ComponentType type) const
+    {
+      return type < mColumnIndices.size() ? mColumnIndices[type] : NO_COLUMN;
+    }
+
+    inline void* getComponent(size_t column, size_t row)
+    {
+      ArchetypeChunk& chunk = mChunks[row / mChunkCapacity];
+      return chunk.mData + mColumnOffsets[column] + (row % mChunkCapacity) * mInfos[column]->stride;
+    }
+
+    // Tags and shared components have no column, for them this returns nullptr
+    template<typename T>
+    inline T* getColumn(ArchetypeChunk& chunk, ComponentType type)
+    {
+      if constexpr (!hasArchetypeColumn<T>)
+      {
+        return nullptr;
+      }
+      else
+      {
+        return reinterpret_cast<T*>(chunk.mData + mColumnOffsets[mColumnIndices[type]]);
+      }
+    }
+
+    inline Entity getEntity(size_t row)
+    {
+      return mChunks[row / mChunkCapacity].getEntities()[row % mChunkCapacity];
+    }
+
+    inline size_t size() const
+    {
+      return mSize;
+    }
+
+    // Appends a row for entity and returns it. The row's components are left
+    // uninitialized for the caller to construct
+    inline size_t appendRow(Entity entity)
+    {
+      if (mSize == mChunks.size() * mChunkCapacity)
+      {
+        mChunks.push_back({ static_cast<std::byte*>(::operator new(mChunkBytes, std::align_val_t(mChunkAlignment))), 0 });
+      }
+      ArchetypeChunk& chunk = mChunks.back();
+      chunk.getEntities()[chunk.mSize++] = entity;
+      return mSize++;
+    }
+
+    inline void destroyRow(size_t row)
+    {
+      for (size_t column = 0; column < mInfos.size(); column++)
+      {
+        mInfos[column]->destruct(getComponent(column, row));
+      }
+    }
+
+    // Moves the last row into row, whose components have to be destroyed or
+    // relocated already, and releases the last chunk once it is empty.
+    // Returns the entity that now occupies row, or the removed entity if it
+    // was the last one
+    inline Entity removeRow(size_t row)
+    {
+      size_t last = mSize - 1;
+      if (row != last)
+      {
+        for (size_t column = 0; column < mInfos.size(); column++)
+        {
+          mInfos[column]->relocate(getComponent(column, row), getComponent(column, last));
+        }
+      }
+
+      Entity moved = getEntity(last);
+      mChunks[row / mChunkCapacity].getEntities()[row % mChunkCapacity] = moved;
+
+      --mSize;
+      if (--mChunks.back().mSize == 0)
+      {
+        ::operator delete(mChunks.back().mData, std::align_val_t(mChunkAlignment));
+        mChunks.pop_back();
+      }
+      return moved;
+    }
+
+  public:
+    Signature mSignature{};
+    std::vector<ComponentType> mTypes{};
+    std::vector<const ComponentInfo*> mInfos{};
+    std::vector<int32_t> mColumnIndices{};
+    std::vector<size_t> mColumnOffsets{};
+    std::vector<ArchetypeChunk> mChunks{};
+    size_t mChunkCapacity{};
+    size_t mChunkBytes{};
+    size_t mChunkAlignment{ CHUNK_ALIGNMENT };
+    size_t mSize{};
+
+    // Cached transitions to the archetypes reached by adding/removing a type
+    absl::flat_hash_map<ComponentType, Archetype*> mAddEdges{};
+    absl::flat_hash_map<ComponentType, Archetype*> mRemoveEdges{};
+
+  private:
+    // Computes the column offsets for chunks of capacity rows and returns the
+    // number of bytes such a chunk needs
+    inline size_t layoutChunk(size_t capacity)
+    {
+      mColumnOffsets.clear();
+      size_t offset = sizeof(Entity) * capacity;
+      for (auto const* info : mInfos)
+      {
+        offset = (offset + info->alignment - 1) / info->alignment * info->alignment;
+        mColumnOffsets.push_back(offset);
+        offset += info->stride * capacity;
+      }
+      return offset;
+    }
+  };
+
+  // Stores components grouped by signature: entities with the same set of
+  // components share one Archetype, adding and removing components moves the
+  // entity's row between archetypes
+  template<typename Config>
+  class ArchetypeManager
+  {
+  public:
+    using Signature = typename Config::Signature;
+    using Archetype = ecs::Archetype<Config>;
+
+    struct EntityRecord
+    {
+      Archetype* archetype; // nullptr while the entity has no components
+      uint32_t row;
+    };
+
+    // Types without an archetype column are registered without info
+    inline void registerComponent(ComponentType type, const ComponentInfo* info)
+    {
+      if (type >= mComponentInfos.size())
+      {
+        mComponentInfos.resize(type + 1);
+      }
+      mComponentInfos[type] = info;
+    }
+
+    // Constructs the component in place in its destination row. args may
+    // refer to the entity's other components, they stay in place until the
+    // new component is built
+    template<typename T, typename... Args>
+    inline void emplaceComponent(Entity entity, ComponentType type, Args&&... args)
+    {
+      addComponent(entity, type, [&](void* component)
+      {
+        if constexpr (hasArchetypeColumn<T>)
+        {
+          new (component) T(std::forward<Args>(args)...);
+        }
+      });
+    }
+
+    // Moves the entity into the archetype including type. construct gets the
+    // uninitialized memory of the new component, or nullptr for types without
+    // a column, and runs before the entity's old row is relocated and freed.
+    // Returns false if the entity already had the component
+    template<typename F>
+    inline bool addComponent(Entity entity, ComponentType type, F&& construct)
+    {
+      EntityRecord& record = getRecord(entity);
+      Archetype* source = record.archetype;
+
+      if (source && source->mSignature.test(type))
+      {
+        LOG_ERROR("Tried adding same component to entity multiple times - adding nothing");
+        return false;
+      }
+
+      Archetype* destination = source ? getAddEdge(source, type) : getArchetype(Signature{}.set(type));
+      uint32_t row = static_cast<uint32_t>(destination->appendRow(entity));
+      int32_t column = destination->getColumnIndex(type);
+      construct(column != Archetype::NO_COLUMN ? destination->getComponent(column, row) : nullptr);
+      leaveRow(record, destination, row);
+      record = { destination, row };
+      return true;
+    }
+
+    // Adds a component without a column, e.g. a tag or relation bit
+    inline void addComponent(Entity entity, ComponentType type)
+    {
+      addComponent(entity, type, [](void*) {});
+    }
+
+    inline void removeComponent(Entity entity, ComponentType type)
+    {
+      EntityRecord& record = getRecord(entity);
+      Archetype* source = record.archetype;
+
+      if (!source || !source->mSignature.test(type))
+      {
+        LOG_ERROR("Tried removing non-existent entity - removing nothing");
+        return;
+      }
+
+      Archetype* destination = getRemoveEdge(source, type);
+      if (destination->mSignature.none())
+      {
+        removeRow(source, record.row);
+        record = { nullptr, 0 };
+        return;
+      }
+
+      uint32_t row = moveEntity(entity, record, destination);
+      record = { destination, row };
+    }
+
+    template<typename T>
+    inline T& getComponent(Entity entity, ComponentType type)
+    {
+      return *static_cast<T*>(getComponent(entity, type));
+    }
+
+    inline void* getComponent(Entity entity, ComponentType type)
+    {
+      EntityRecord& record = getRecord(entity);
+
+      if (!record.archetype || record.archetype->getColumnIndex(type) == Archetype::NO_COLUMN)
+      {
+        LOG_ERROR("Tried to retrieve data of non-existent entity");
+        assert(false);
+      }
+
+      return record.archetype->getComponent(record.archetype->mColumnIndices[type], record.row);
+    }
+
+    // Appends rows for new entities without components to the archetype of
+    // signature and returns the record of the first one, the others follow in
+    // consecutive rows. The components are left for the caller to construct
+    inline EntityRecord createEntities(const EntityRange& entities, const Signature& signature)
+    {
+      if (signature.none() || !entities.size())
+      {
+        return { nullptr, 0 };
+      }
+
+      Archetype* archetype = getArchetype(signature);
+      EntityRecord first{ archetype, static_cast<uint32_t>(archetype->size()) };
+      for (Entity entity : entities)
+      {
+        getRecord(entity) = { archetype, static_cast<uint32_t>(archetype->appendRow(entity)) };
+      }
+      return first;
+    }
+
+    // Like createEntities, but fills the rows with copies of the components of
+    // source, column by column. Types without a column are left to the caller
+    inline EntityRecord cloneEntities(Entity source, const EntityRange& entities, const Signature& signature)
+    {
+      EntityRecord first = createEntities(entities, signature);
+      EntityRecord from = getRecord(source);
+      if (!first.archetype)
+      {
+        return first;
+      }
+
+      Archetype* archetype = first.archetype;
+      for (size_t column = 0; column < archetype->mTypes.size(); column++)
+      {
+        const void* component = from.archetype->getComponent(from.archetype->getColumnIndex(archetype->mTypes[column]), from.row);
+        for (size_t row = first.row; row < first.row + entities.size(); row++)
+        {
+          archetype->mInfos[column]->copy(archetype->getComponent(column, row), component);
+        }
+      }
+      return first;
+    }
+
+    inline void entityDestroyed(Entity entity)
+    {
+      EntityRecord& record = getRecord(entity);
+      if (record.archetype)
+      {
+        removeRow(record.archetype, record.row);
+        record = { nullptr, 0 };
+      }
+    }
+
+    // Removes the rows highest first, so every hole is filled from a row that
+    // stays rather than from one about to be removed
+    inline void entitiesDestroyed(std::vector<Entity> entities)
+    {
+      std::sort(entities.begin(), entities.end(), [&](Entity a, Entity b)
+      {
+        return getRecord(a).row > getRecord(b).row;
+      });
+      for (Entity entity : entities)
+      {
+        entityDestroyed(entity);
+      }
+    }
+
+    // Calls func for every archetype containing at least the components in
+    // signature. The list of matching archetypes is cached per signature
+    template<typename F>
+    inline void forEachArchetype(const Signature& signature, F&& func)
+    {
+      auto it = mQueries.find(signature);
+      if (it == mQueries.end())
+      {
+        std::vector<Archetype*> matches{};
+        for (auto const& pair : mArchetypes)
+        {
+          if (matchesQuery(pair.first, signature))
+          {
+            matches.push_back(pair.second.get());
+          }
+        }
+        it = mQueries.insert({signature, std::move(matches)}).first;
+      }
+
+      for (Archetype* archetype : it->second)
+      {
+        if (archetype->size())
+        {
+          func(*archetype);
+        }
+      }
+    }
+
+  public:
+    absl::flat_hash_map<Signature, std::unique_ptr<Archetype>> mArchetypes{};
+    absl::flat_hash_map<Signature, std::vector<Archetype*>> mQueries{};
+    std::vector<const ComponentInfo*> mComponentInfos{};
+    std::vector<EntityRecord> mRecords{};
+
+  private:
+    inline static bool matchesQuery(const Signature& archetype, const Signature& query)
+    {
+      return (archetype & query) == query && (!archetype.test(PREFAB_TYPE) || query.test(PREFAB_TYPE));
+    }
+
+    inline EntityRecord& getRecord(Entity entity)
+    {
+      Entity index = entityIndex(entity);
+      if (index >= mRecords.size())
+      {
+        mRecords.resize(index + 1, EntityRecord{ nullptr, 0 });
+      }
+      return mRecords[index];
+    }
+
+    inline Archetype* getArchetype(const Signature& signature)
+    {
+      auto it = mArchetypes.find(signature);
+      if (it != mArchetypes.end())
+      {
+        return it->second.get();
+      }
+
+      std::vector<ComponentType> types{};
+      std::vector<const ComponentInfo*> infos{};
+      for (ComponentType type = 0; type < mComponentInfos.size(); type++)
+      {
+        if (signature.test(type) && mComponentInfos[type])
+        {
+          types.push_back(type);
+          infos.push_back(mComponentInfos[type]);
+        }
+      }
+      auto archetype = std::make_unique<Archetype>(signature, std::move(types), std::move(infos));
+
+      for (auto& pair : mQueries)
+      {
+        if (matchesQuery(signature, pair.first))
+        {
+          pair.second.push_back(archetype.get());
+        }
+      }
+
+      return mArchetypes.insert({signature, std::move(archetype)}).first->second.get();
+    }
+
+    inline Archetype* getAddEdge(Archetype* source, ComponentType type)
+    {
+      Archetype*& edge = source->mAddEdges[type];
+      if (!edge)
+      {
+        edge = getArchetype(Signature{source->mSignature}.set(type));
+      }
+      return edge;
+    }
+
+    inline Archetype* getRemoveEdge(Archetype* source, ComponentType type)
+    {
+      Archetype*& edge = source->mRemoveEdges[type];
+      if (!edge)
+      {
+        edge = getArchetype(Signature{source->mSignature}.reset(type));
+      }
+      return edge;
+    }
+
+    inline void removeRow(Archetype* archetype, uint32_t row)
+    {
+      archetype->destroyRow(row);
+      fillRow(archetype, row);
+    }
+
+    inline void fillRow(Archetype* archetype, uint32_t row)
+    {
+      Entity moved = archetype->removeRow(row);
+      if (row < archetype->size())
+      {
+        mRecords[entityIndex(moved)].row = row;
+      }
+    }
+
+    // Appends a row for entity to destination, relocating every component
+    // both archetypes share, and removes the entity's old row. Components only
+    // present in destination are left for the caller to construct
+    inline uint32_t moveEntity(Entity entity, EntityRecord& record, Archetype* destination)
+    {
+      uint32_t row = static_cast<uint32_t>(destination->appendRow(entity));
+      leaveRow(record, destination, row);
+      return row;
+    }
+
+    // Relocates the components of the entity's old row that destination
+    // shares into row, destroys the others and removes the old row
+    inline void leaveRow(const EntityRecord& record, Archetype* destination, uint32_t row)
+    {
+      Archetype* source = record.archetype;
+      if (source)
+      {
+        for (size_t i = 0; i < source->mTypes.size(); i++)
+        {
+          int32_t column = destination->getColumnIndex(source->mTypes[i]);
+          if (column != Archetype::NO_COLUMN)
+          {
+            source->mInfos[i]->relocate(destination->getComponent(column, row), source->getComponent(i, record.row));
+          }
+          else
+          {
+            source->mInfos[i]->destruct(source->getComponent(i, record.row));
+          }
+        }
+        fillRow(source, record.row);
+      }
+    }
+  };
+
+  // Freed slots are kept on a stack of the handles their next entities get,
+  // i.e. with the generation bumped. Reservations, which may come from
+  // several threads, pop from it by decrementing an atomic count of the
+  // entries not taken yet, and flushReservedEntities drops the taken ones.
+  // Slots and signatures are allocated a page at a time as the world grows,
+  // so construction allocates nothing and a slot never moves once created.
+  // The stack gets a page per page of slots, so it has room for every slot
+  // and destroying an entity never allocates. Signature pages come from
+  // calloc, whose large blocks are fresh pages zeroed lazily by the OS on
+  // first touch
+  template<typename Config>
+  class EntityManager
+  {
+  public:
+    using Signature = typename Config::Signature;
+
+    static constexpr size_t PAGE_SIZE = 4096;
+
+    EntityManager() = default;
+    EntityManager(const EntityManager&) = delete;
+    EntityManager& operator=(const EntityManager&) = delete;
+
+    inline ~EntityManager()
+    {
+      for (Entity* page : mEntityPages)
+      {
+        std::free(page);
+      }
+      for (Signature* page : mSignaturePages)
+      {
+        std::free(page);
+      }
+      for (size_t page = 0; page < mEntityPages.size(); page++)
+      {
+        std::free(mFreePages.load(std::memory_order_relaxed)[page]);
+      }
+    }
+
+    inline Entity createEntity()
+    {
+      Entity entity = reserveEntity();
+      flushReservedEntities();
+      return entity;
+    }
+
+    // Hands out count entities in one go, all starting with signature. Freed
+    // slots are taken first, the rest are fresh
+    inline EntityRange createEntities(Entity count, const Signature& signature)
+    {
+      EntityRange entities = reserveEntities(count);
+      flushReservedEntities();
+
+      for (Entity entity : entities)
+      {
+        this->signature(entity) = signature;
+      }
+      return entities;
+    }
+
+    // Reserves an entity, reusing a freed slot if there is one. Unlike the
+    // rest of the EntityManager, reserving may be called from several threads
+    // at once and alongside createEntity(ies) and flushReservedEntities, but
+    // not alongside destroyEntity, which pushes onto the stack. It takes one
+    // atomic subtraction and, once no freed slots are left, one atomic add.
+    // The entities become alive, without components, with the next
+    // flushReservedEntities
+    inline Entity reserveEntity()
+    {
+      int64_t position = mFreeAvailable.fetch_sub(1, std::memory_order_relaxed) - 1;
+      if (position >= 0)
+      {
+        return freeEntry(position);
+      }
+
+      Entity index = mReserved.fetch_add(1, std::memory_order_relaxed);
+      if (index >= Config::MAX_ENTITIES)
+      {
+        LOG_ERROR("Tried to reserve new entities, when not enough entities are available");
+        assert(false);
+        return NULL_ENTITY;
+      }
+      return makeEntity(index, 0);
+    }
+
+    inline EntityRange reserveEntities(Entity count)
+    {
+      int64_t end = mFreeAvailable.fetch_sub(count, std::memory_order_relaxed);
+      EntityRange entities{};
+      entities.mEntities.reserve(count);
+      for (int64_t position = std::max<int64_t>(end - count, 0); position < end; position++)
+      {
+        entities.mEntities.push_back(freeEntry(position));
+      }
+
+      Entity fresh = count - static_cast<Entity>(entities.size());
+      if (fresh == 0)
+      {
+        return entities;
+      }
+
+      Entity first = mReserved.fetch_add(fresh, std::memory_order_relaxed);
+      if (fresh > Config::MAX_ENTITIES || first > Config::MAX_ENTITIES - fresh)
+      {
+        LOG_ERROR("Tried to reserve new entities, when not enough entities are available");
+        assert(false);
+        return entities;
+      }
+      for (Entity index = first; index < first + fresh; index++)
+      {
+        entities.mEntities.push_back(makeEntity(index, 0));
+      }
+      return entities;
+    }
+
+    // Brings every entity reserved so far to life. Entities reserved while
+    // this runs are left for the next flush
+    inline void flushReservedEntities()
+    {
+      // Reservations running past the freed slots leave the count negative
+      int64_t available = mFreeAvailable.load(std::memory_order_relaxed);
+      while (available < 0 && !mFreeAvailable.compare_exchange_weak(available, 0, std::memory_order_relaxed))
+      {
+      }
+
+      size_t remaining = static_cast<size_t>(std::max<int64_t>(available, 0));
+      for (size_t position = remaining; position < mFreeCount; position++)
+      {
+        slot(entityIndex(freeEntry(position))) = freeEntry(position);
+      }
+      mLivingEntityCount += static_cast<uint32_t>(mFreeCount - remaining);
+      mFreeCount = remaining;
+
+      Entity reserved = std::min(mReserved.load(std::memory_order_relaxed), Config::MAX_ENTITIES);
+      while (mEntityPages.size() * PAGE_SIZE < reserved)
+      {
+        mEntityPages.push_back(static_cast<Entity*>(std::malloc(PAGE_SIZE * sizeof(Entity))));
+        mSignaturePages.push_back(static_cast<Signature*>(std::calloc(PAGE_SIZE, sizeof(Signature))));
+        addFreePage();
+      }
+
+      for (Entity index = mCreated; index < reserved; index++)
+      {
+        slot(index) = makeEntity(index, 0);
+      }
+      mLivingEntityCount += reserved - mCreated;
+      mCreated = reserved;
+    }
+
+    inline bool isAlive(Entity entity)
+    {
+      Entity index = entityIndex(entity);
+      return index < mCreated && slot(index) == entity;
+    }
+
+    inline void destroyEntity(Entity entity)
+    {
+      if (!isAlive(entity))
+      {
+        LOG_ERROR("Tried to delete non-existent entity - deleting nothing");
+        return;
+      }
+
+      Entity index = entityIndex(entity);
+      signature(entity).reset();
+      slot(index) = NULL_ENTITY;
+
+      // Entries past the available ones are reserved already, the new one
+      // goes below them
+      int64_t available = std::max<int64_t>(mFreeAvailable.load(std::memory_order_relaxed), 0);
+      freeEntry(mFreeCount) = makeEntity(index, entityGeneration(entity) + 1);
+      std::swap(freeEntry(available), freeEntry(mFreeCount));
+      mFreeCount++;
+      mFreeAvailable.store(available + 1, std::memory_order_relaxed);
+      --mLivingEntityCount;
+    }
+
+    // Calls func(entity) for every living entity, in index order
+    template<typename F>
+    inline void forEachEntity(F&& func)
+    {
+      for (Entity index = 0; index < mCreated; index++)
+      {
+        if (entityIndex(slot(index)) == index)
+        {
+          func(slot(index));
+        }
+      }
+    }
+
+    inline void setSignature(Entity entity, const Signature& signature)
+    {
+      if (!isAlive(entity))
+      {
+        LOG_ERROR("Tried to change signature of non-existent entity - changing nothing");
+        return;
+      }
+
+      this->signature(entity) = signature;
+    }
+
+    inline const Signature& getSignature(Entity entity)
+    {
+      if (!isAlive(entity))
+      {
+        LOG_ERROR("Tried to get signature of non-existent entity");
+        assert(false);
+      }
+      return signature(entity);
+    }
+
+    // Unchecked access to the signature, expects entity to be alive
+    inline Signature& signature(Entity entity)
+    {
+      Entity index = entityIndex(entity);
+      return mSignaturePages[index / PAGE_SIZE][index % PAGE_SIZE];
+    }
+
+  public:
+    std::vector<Entity*> mEntityPages {}; // Per index the living entity, NULL_ENTITY if the slot is free
+    std::vector<Signature*> mSignaturePages {}; // Signatures corresponding to entity indices
+    std::atomic<Entity**> mFreePages {}; // Pages of the stack of next handles of freed slots, one per page of slots
+    std::vector<std::unique_ptr<Entity*[]>> mFreeTables {}; // Every table mFreePages pointed to, the last one current
+    size_t mFreeTableSize {}; // Number of pages the current table has room for
+    size_t mFreeCount {}; // Entries on the stack, reserved or not
+    std::atomic<int64_t> mFreeAvailable {}; // Entries on the stack not reserved yet, negative once reservations ran past them
+    Entity mCreated {}; // Number of slots handed out so far
+    std::atomic<Entity> mReserved {}; // Number of slots handed out or reserved so far
+    uint32_t mLivingEntityCount {};
+
+  private:
+    inline Entity& slot(Entity index)
+    {
+      return mEntityPages[index / PAGE_SIZE][index % PAGE_SIZE];
+    }
+
+    inline Entity& freeEntry(size_t position)
+    {
+      return mFreePages.load(std::memory_order_acquire)[position / PAGE_SIZE][position % PAGE_SIZE];
+    }
+
+    // Gives the stack a page for the slot page just added. Reservations may
+    // read the table meanwhile, so a full table is replaced by a copy twice
+    // its size and kept alive until destruction
+    inline void addFreePage()
+    {
+      size_t page = mEntityPages.size() - 1;
+      Entity** table = mFreePages.load(std::memory_order_relaxed);
+      if (page >= mFreeTableSize)
+      {
+        mFreeTableSize = std::max<size_t>(mFreeTableSize * 2, 16);
+        mFreeTables.emplace_back(new Entity*[mFreeTableSize]);
+        std::copy_n(table, page, mFreeTables.back().get());
+        table = mFreeTables.back().get();
+      }
+      table[page] = static_cast<Entity*>(std::malloc(PAGE_SIZE * sizeof(Entity)));
+      mFreePages.store(table, std::memory_order_release);
+    }
+  };
+
+  // mEntities keeps listing entities marked by destroyEntityDeferred until
+  // the next flushDestroyedEntities, check Coordinator::isDestroyPending where
+  // they must be skipped
+  class System
+  {
+  public:
+    std::set<Entity> mEntities;
+
+    virtual ~System() = default;
+
+    virtual void entityRegistered(Entity)
+    {
+
+    }
+
+    virtual void entityErased(Entity)
+    {
+
+    }
+  };
+
+  template<typename Config>
+  class SystemManager
+  {
+  public:
+    using Signature = typename Config::Signature;
+
+    template<typename T, typename... Args>
+    inline T* registerSystem(Args... args)
+    {
+      const char* typeName = typeid(T).name();
+
+      if (mSystems.find(typeName) != mSystems.end())
+      {
+        LOG_ERROR("Tried registering a system multiple times!");
+        assert(false);
+      }
+
+      T* system = new T(args...);
+      mSystems.insert({typeName, (System*)(system)}); // ? delete cast
+      return system;
+    }
+
+    // A system takes part in matching once its signature is set. Entities
+    // already around catch up through entityRefreshed
+    template<typename T>
+    inline void setSignature(const Signature& signature)
+    {
+      const char* typeName = typeid(T).name();
+      if (mSystems.find(typeName) == mSystems.end())
+      {
+        LOG_ERROR("Tried setting Signature for unregistered System - setting nothing");
+        return;
+      }
+
+      mSignatures.insert({typeName, signature});
+      refreshNodes();
+    }
+
+    // Systems only hold the entities of their node, so the others need not be
+    // searched
+    inline void entityDestroyed(Entity entity)
+    {
+      Node*& node = getEntityNode(entity);
+      if (node)
+      {
+        for (System* system : node->mSystems)
+        {
+          system->mEntities.erase(entity);
+        }
+        node = nullptr;
+      }
+    }
+
+    inline void entitiesDestroyed(const std::vector<Entity>& entities)
+    {
+      for (Entity entity : entities)
+      {
+        entityDestroyed(entity);
+      }
+    }
+
+    // Singleton bits in system signatures are satisfied by the world rather
+    // than by the entity
+    inline void singletonChanged(ComponentType type, bool present)
+    {
+      mSingletons.set(type, present);
+      if (dependsOn(type))
+      {
+        refreshNodes();
+      }
+    }
+
+    inline bool dependsOn(ComponentType type)
+    {
+      for (auto const& pair : mSignatures)
+      {
+        if (pair.second.test(type))
+        {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    // Follows the edge for adding or removing type from the entity's node,
+    // notifying only the systems its membership changes for. entitySignature
+    // is the signature after the change
+    inline void entityComponentChanged(Entity entity, ComponentType type, bool added, const Signature& entitySignature)
+    {
+      Node* source = getEntityNode(entity);
+      if (!source)
+      {
+        Node* node = getNode(entitySignature);
+        mEntityNodes[entityIndex(entity)] = node;
+        for (System* system : node->mSystems)
+        {
+          system->mEntities.insert(entity);
+          system->entityRegistered(entity);
+        }
+        return;
+      }
+
+      const Edge& edge = getEdge(source, type, added);
+      mEntityNodes[entityIndex(entity)] = edge.node;
+      notify(entity, edge);
+    }
+
+    // Applies what the last refreshNodes changed for the entity's node
+    inline void entityRefreshed(Entity entity)
+    {
+      Node* node = getEntityNode(entity);
+      if (node)
+      {
+        notify(entity, node->mRefreshed);
+      }
+    }
+
+    // Adds new entities sharing one signature to the systems of its node
+    inline void entitiesCreated(const EntityRange& entities, const Signature& entitySignature)
+    {
+      Node* node = getNode(entitySignature);
+      for (System* system : node->mSystems)
+      {
+        for (Entity entity : entities)
+        {
+          system->mEntities.insert(system->mEntities.end(), entity);
+          system->entityRegistered(entity);
+        }
+      }
+
+      for (Entity entity : entities)
+      {
+        getEntityNode(entity) = node;
+      }
+    }
+
+    inline ~SystemManager()
+    {
+      for (auto const& pair : mSystems)
+      {
+        delete pair.second;
+      }
+    }
+
+    // Prefabs only match systems asking for Prefab
+    inline static bool matches(const Signature& signature, const Signature& systemSignature)
+    {
+      return (signature & systemSignature) == systemSignature
+        && (!signature.test(PREFAB_TYPE) || systemSignature.test(PREFAB_TYPE));
+    }
+  private:
+    // Moving an entity between nodes adds it to the added systems and removes
+    // it from the removed ones
+    struct Node;
+
+    struct Edge
+    {
+      Node* node{};
+      std::vector<System*> added{};
+      std::vector<System*> removed{};
+    };
+
+    // The systems matching one entity signature, sorted by address. Entities
+    // point to the node of their signature, edges lead to the node reached by
+    // adding or removing a component type
+    struct Node
+    {
+      Signature mSignature;
+      std::vector<System*> mSystems;
+      Edge mRefreshed; // What the last refreshNodes changed
+      absl::flat_hash_map<ComponentType, std::unique_ptr<Edge>> mAddEdges{}; // Boxed, systems' callbacks may add edges
+      absl::flat_hash_map<ComponentType, std::unique_ptr<Edge>> mRemoveEdges{};
+    };
+
+  public:
+    absl::flat_hash_map<const char*, Signature> mSignatures{};
+    absl::flat_hash_map<const char*, System*> mSystems{};
+    Signature mSingletons{}; // Singletons currently set in the world
+    absl::flat_hash_map<Signature, std::unique_ptr<Node>> mNodes{};
+    std::vector<Node*> mEntityNodes{}; // Indexed by entity index, nullptr while in no node
+
+  private:
+    inline Node*& getEntityNode(Entity entity)
+    {
+      Entity index = entityIndex(entity);
+      if (index >= mEntityNodes.size())
+      {
+        mEntityNodes.resize(index + 1, nullptr);
+      }
+      return mEntityNodes[index];
+    }
+
+    inline Node* getNode(const Signature& signature)
+    {
+      auto it = mNodes.find(signature);
+      if (it == mNodes.end())
+      {
+        auto node = std::make_unique<Node>();
+        node->mSignature = signature;
+        node->mSystems = matchingSystems(signature);
+        node->mRefreshed.node = node.get();
+        it = mNodes.insert({signature, std::move(node)}).first;
+      }
+      return it->second.get();
+    }
+
+    inline const Edge& getEdge(Node* source, ComponentType type, bool added)
+    {
+      std::unique_ptr<Edge>& edge = added ? source->mAddEdges[type] : source->mRemoveEdges[type];
+      if (!edge)
+      {
+        Node* destination = getNode(Signature{source->mSignature}.set(type, added));
+        edge = std::make_unique<Edge>(Edge{ destination, difference(destination->mSystems, source->mSystems), difference(source->mSystems, destination->mSystems) });
+      }
+      return *edge;
+    }
+
+    inline std::vector<System*> matchingSystems(const Signature& entitySignature)
+    {
+      const Signature signature = entitySignature | mSingletons;
+      std::vector<System*> systems{};
+      for (auto const& pair : mSignatures)
+      {
+        if (matches(signature, pair.second))
+        {
+          systems.push_back(mSystems[pair.first]);
+        }
+      }
+      std::sort(systems.begin(), systems.end());
+      return systems;
+    }
+
+    // Recomputes the systems of every node after system signatures or
+    // singletons changed. Edges are dropped, they are rebuilt on demand
+    inline void refreshNodes()
+    {
+      for (auto const& pair : mNodes)
+      {
+        Node* node = pair.second.get();
+        std::vector<System*> systems = matchingSystems(node->mSignature);
+        node->mRefreshed.added = difference(systems, node->mSystems);
+        node->mRefreshed.removed = difference(node->mSystems, systems);
+        node->mSystems = std::move(systems);
+        node->mAddEdges.clear();
+        node->mRemoveEdges.clear();
+      }
+    }
+
+    inline void notify(Entity entity, const Edge& edge)
+    {
+      for (System* system : edge.removed)
+      {
+        system->mEntities.erase(entity);
+        system->entityErased(entity);
+      }
+      for (System* system : edge.added)
+      {
+        system->mEntities.insert(entity);
+        system->entityRegistered(entity);
+      }
+    }
+
+    inline static std::vector<System*> difference(const std::vector<System*>& a, const std::vector<System*>& b)
+    {
+      std::vector<System*> result{};
+      std::set_difference(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(result));
+      return result;
+    }
+  };
+
+  class IResourceArray
+  {
+
+  };
+
+  template <typename T>
+  class ResourceArray : IResourceArray
+  {
+  public:
+    inline T*& getResource(const char* key)
+    {
+      absl::string_view view = key;
+      return data[view];
+    }
+    inline T*& getResource(std::string key)
+    {
+      return getResource(key.c_str());
+    }
+
+    inline void setResource(const char* key, T* value)
+    {
+      absl::string_view view = key;
+      data[view] = value;
+    }
+    inline void setResource(std::string key, T* value)
+    {
+      setResource(key.c_str(), value);
+    }
+
+    inline void deleteResource(const char* key)
+    {
+      absl::string_view view = key;
+      // delete data[view];
+      data.erase(view);
+    }
+    inline void deleteResource(std::string key)
+    {
+      deleteResource(key.c_str());
+    }
+
+    inline void deleteAll()
+    {
+      // for (auto& d : data)
+      // {
+      //   // T*& temp;
+      //   if(d.second) delete d.second;
+      //   // absl::string_view view = d.first;
+      //   // data.erase(view);
+      //   // delete temp;
+      // }
+      data.clear();
+    }
+
+    inline T*& operator[](const char* key)
+    {
+      absl::string_view view = key;
+      return data[view];
+    }
+    inline T*& operator[](std::string key)
+    {
+      return this[key.c_str()];
+    }
+  private:
+    absl::flat_hash_map<std::string, T*> data;
+  };
+
+  class ResourceManager
+  {
+  public:
+    template<typename T>
+    inline void registerResourceType()
+    {
+      const char* name = typeid(T).name();
+      if (resourceArrays.find(name) != resourceArrays.end())
+      {
+        LOG_ERROR("Tried to register resource multiple times - registering nothing");
+        return;
+      }
+      resourceArrays.insert({name, reinterpret_cast<IResourceArray*>(new ResourceArray<T>())});
+      // resourceArrays[name] = reinterpret_cast<IResourceArray*>(new ResourceArray<T>());
+    }
+
+    template<typename T>
+    inline T*& getResource(const char* key)
+    {
+      const char* name = typeid(T).name();
+      return getResourceArray<T>()->getResource(key);
+    }
+    template<typename T>
+    inline T*& getResource(std::string key)
+    {
+      return getResource<T>(key.c_str());
+    }
+
+    template<typename T>
+    inline void setResource(const char* key, T* value)
+    {
+      const char* name = typeid(T).name();
+      getResourceArray<T>()->setResource(key, value);
+    }
+    template<typename T>
+    inline void setResource(std::string key, T* value)
+    {
+      setResource<T>(key.c_str(), value);
+    }
+
+    template<typename T>
+    inline void deleteResource(const char* key)
+    {
+      getResourceArray<T>()->deleteResource(key);
+    }
+    template<typename T>
+    inline void deleteResource(std::string key)
+    {
+      deleteResource<T>(key.c_str());
+    }
+
+    template<typename... Args>
+    struct RecursiveDelete;
+
+    template<typename First, typename... Args>
+    struct RecursiveDelete<First, Args...>
+    {
+      static inline void deleteAll(ResourceManager& r)
+      {
+        r.getResourceArray<First>()->deleteAll();
+        RecursiveDelete<Args...>::deleteAll(r);
+      }
+    };
+    template<>
+    struct RecursiveDelete<>
+    {
+      static inline void deleteAll(ResourceManager& r) { }
+    };
+    template<typename... Args>
+    void deleteAll()
+    {
+      RecursiveDelete<Args...>::deleteAll(*this);
+    }
+
+    inline ~ResourceManager()
+    {
+      for (auto& a : resourceArrays)
+      {
+        delete a.second;
+      }
+    }
+  private:
+    absl::flat_hash_map<const char*, IResourceArray*> resourceArrays;
+
+    template<typename T>
+    ResourceArray<T>* getResourceArray()
+    {
+      const char* typeName = typeid(T).name();
+
+      if(resourceArrays.find(typeName) == resourceArrays.end())
+      {
+        LOG_ERROR("Tried to use unregistered component!");
+        assert(false);
+      }
+
+      // return static_cast<ComponentArray<T>*>(mComponentArrays[typeName]);
+      // ComponentArray<T>* temp = mComponentArrays[typeName];
+      // return temp;
+      return reinterpret_cast<ResourceArray<T>*>(resourceArrays[typeName]);
+    }
+  };
+
+  // Parent/child relations between entities. Entities are kept in levels by
+  // depth, level d holding every entity d steps below its root, so walking
+  // the levels in order visits each parent before its children with one
+  // linear pass per level. Each entry knows the position of its parent in the
+  // level above, which is all propagation needs. Reparenting moves only the
+  // reparented subtree between levels
+  class Hierarchy
+  {
+  public:
+    struct Node
+    {
+      Entity parent;
+      Entity firstChild;
+      Entity nextSibling;
+      Entity prevSibling;
+      uint32_t depth;
+      uint32_t position; // Index in mLevels[depth]
+    };
+
+    struct Level
+    {
+      std::vector<Entity> entities;
+      std::vector<uint32_t> parents; // Position of each entity's parent in the level above
+      std::vector<uint8_t> dirty;
+    };
+
+    inline bool contains(Entity entity) const
+    {
+      return mEntities.contains(entity);
+    }
+
+    // Makes child a child of parent, or a root if parent is NULL_ENTITY,
+    // together with its subtree. Entities not in the hierarchy yet join it
+    inline void setParent(Entity child, Entity parent)
+    {
+      if (!contains(child))
+      {
+        insertRoot(child);
+      }
+      if (parent != NULL_ENTITY && !contains(parent))
+      {
+        insertRoot(parent);
+      }
+      for (Entity ancestor = parent; ancestor != NULL_ENTITY; ancestor = node(ancestor).parent)
+      {
+        if (ancestor == child)
+        {
+          LOG_ERROR("Tried to make entity a child of its own subtree - reparenting nothing");
+          return;
+        }
+      }
+
+      unlink(child);
+      Node& childNode = node(child);
+      childNode.parent = parent;
+      uint32_t depth = 0;
+      if (parent != NULL_ENTITY)
+      {
+        Node& parentNode = node(parent);
+        childNode.nextSibling = parentNode.firstChild;
+        if (parentNode.firstChild != NULL_ENTITY)
+        {
+          node(parentNode.firstChild).prevSibling = child;
+        }
+        parentNode.firstChild = child;
+        depth = parentNode.depth + 1;
+      }
+
+      if (depth == childNode.depth)
+      {
+        mLevels[depth].parents[childNode.position] = parentPosition(child);
+        mLevels[depth].dirty[childNode.position] = 1;
+      }
+      else
+      {
+        moveSubtree(child, depth);
+      }
+    }
+
+    inline Entity getParent(Entity entity)
+    {
+      return contains(entity) ? node(entity).parent : NULL_ENTITY;
+    }
+
+    // Calls func(child) for each direct child of entity
+    template<typename F>
+    inline void forEachChild(Entity entity, F&& func)
+    {
+      if (!contains(entity))
+      {
+        return;
+      }
+      for (Entity child = node(entity).firstChild; child != NULL_ENTITY;)
+      {
+        Entity next = node(child).nextSibling;
+        func(child);
+        child = next;
+      }
+    }
+
+    // Marks entity and, at the next propagate, its whole subtree as changed
+    inline void markDirty(Entity entity)
+    {
+      if (contains(entity))
+      {
+        Node& entityNode = node(entity);
+        mLevels[entityNode.depth].dirty[entityNode.position] = 1;
+      }
+    }
+
+    // Calls func(entity, parent) for every entity that is dirty or has a
+    // dirty ancestor, parents first, with parent NULL_ENTITY for roots.
+    // Clean subtrees are skipped. Clears the dirty marks. The hierarchy must
+    // not change inside func
+    template<typename F>
+    inline void propagate(F&& func)
+    {
+      for (size_t depth = 0; depth < mLevels.size(); depth++)
+      {
+        Level& level = mLevels[depth];
+        for (size_t i = 0; i < level.entities.size(); i++)
+        {
+          if (depth && mLevels[depth - 1].dirty[level.parents[i]])
+          {
+            level.dirty[i] = 1;
+          }
+          if (level.dirty[i])
+          {
+            func(level.entities[i], depth ? mLevels[depth - 1].entities[level.parents[i]] : NULL_ENTITY);
+          }
+        }
+        if (depth)
+        {
+          std::fill(mLevels[depth - 1].dirty.begin(), mLevels[depth - 1].dirty.end(), 0);
+        }
+      }
+      if (!mLevels.empty())
+      {
+        std::fill(mLevels.back().dirty.begin(), mLevels.back().dirty.end(), 0);
+      }
+    }
+
+    // Like propagate, calling func(value, parentValue) with the T* resolve
+    // returns for each dirty entity and for its parent, or nullptr for roots.
+    // The values of a level are kept by position while the next level is
+    // walked, so each entity is resolved at most once and siblings share
+    // their parent's value
+    template<typename T, typename R, typename F>
+    inline void propagate(R&& resolve, F&& func)
+    {
+      std::vector<T*> above{};
+      std::vector<T*> current{};
+      for (size_t depth = 0; depth < mLevels.size(); depth++)
+      {
+        Level& level = mLevels[depth];
+        current.assign(level.entities.size(), nullptr);
+        for (size_t i = 0; i < level.entities.size(); i++)
+        {
+          if (depth && mLevels[depth - 1].dirty[level.parents[i]])
+          {
+            level.dirty[i] = 1;
+          }
+          if (level.dirty[i])
+          {
+            T* parent = nullptr;
+            if (depth)
+            {
+              // Clean parents of dirty children are resolved on first use
+              T*& value = above[level.parents[i]];
+              if (!value)
+              {
+                value = resolve(mLevels[depth - 1].entities[level.parents[i]]);
+              }
+              parent = value;
+            }
+            current[i] = resolve(level.entities[i]);
+            func(*current[i], parent);
+          }
+        }
+        if (depth)
+        {
+          std::fill(mLevels[depth - 1].dirty.begin(), mLevels[depth - 1].dirty.end(), 0);
+        }
+        std::swap(above, current);
+      }
+      if (!mLevels.empty())
+      {
+        std::fill(mLevels.back().dirty.begin(), mLevels.back().dirty.end(), 0);
+      }
+    }
+
+    // The children of a destroyed entity become roots
+    inline void entityDestroyed(Entity entity)
+    {
+      if (!contains(entity))
+      {
+        return;
+      }
+
+      forEachChild(entity, [&](Entity child)
+      {
+        setParent(child, NULL_ENTITY);
+      });
+      unlink(entity);
+      Node& entityNode = node(entity);
+      removeFromLevel(entityNode.depth, entityNode.position);
+
+      size_t indexOfLastElement = mEntities.size() - 1;
+      size_t indexOfRemovedEntity = mEntities.erase(entity);
+      mNodes[indexOfRemovedEntity] = mNodes[indexOfLastElement];
+      mNodes.pop_back();
+    }
+
+  public:
+    std::vector<Level> mLevels{};
+
+    SparseSet mEntities{};
+
+    std::vector<Node> mNodes{}; // Parallel to mEntities' dense side
+
+  private:
+    inline Node& node(Entity entity)
+    {
+      return mNodes[mEntities.index(entity)];
+    }
+
+    inline uint32_t parentPosition(Entity entity)
+    {
+      Entity parent = node(entity).parent;
+      return parent != NULL_ENTITY ? node(parent).position : 0;
+    }
+
+    inline void insertRoot(Entity entity)
+    {
+      mEntities.insert(entity);
+      mNodes.push_back({ NULL_ENTITY, NULL_ENTITY, NULL_ENTITY, NULL_ENTITY, 0, 0 });
+      addToLevel(entity, 0);
+    }
+
+    // Takes entity out of its parent's list of children
+    inline void unlink(Entity entity)
+    {
+      Node& entityNode = node(entity);
+      if (entityNode.prevSibling != NULL_ENTITY)
+      {
+        node(entityNode.prevSibling).nextSibling = entityNode.nextSibling;
+      }
+      else if (entityNode.parent != NULL_ENTITY)
+      {
+        node(entityNode.parent).firstChild = entityNode.nextSibling;
+      }
+      if (entityNode.nextSibling != NULL_ENTITY)
+      {
+        node(entityNode.nextSibling).prevSibling = entityNode.prevSibling;
+      }
+      entityNode.parent = NULL_ENTITY;
+      entityNode.nextSibling = NULL_ENTITY;
+      entityNode.prevSibling = NULL_ENTITY;
+    }
+
+    // Appends entity to the level of depth as dirty, below its parent
+    inline void addToLevel(Entity entity, uint32_t depth)
+    {
+      if (depth >= mLevels.size())
+      {
+        mLevels.resize(depth + 1);
+      }
+      Level& level = mLevels[depth];
+      Node& entityNode = node(entity);
+      entityNode.depth = depth;
+      entityNode.position = static_cast<uint32_t>(level.entities.size());
+      level.entities.push_back(entity);
+      level.parents.push_back(parentPosition(entity));
+      level.dirty.push_back(1);
+    }
+
+    // Fills the hole with the level's last entry, pointing the children of
+    // that entry to its new position. While a subtree moves down, the removed
+    // entity may be a child of that entry, in the same level
+    inline void removeFromLevel(uint32_t depth, uint32_t position)
+    {
+      Level& level = mLevels[depth];
+      size_t last = level.entities.size() - 1;
+      if (position != last)
+      {
+        Entity removed = level.entities[position];
+        Entity moved = level.entities[last];
+        level.entities[position] = moved;
+        level.parents[position] = level.parents[last];
+        level.dirty[position] = level.dirty[last];
+        node(moved).position = position;
+        for (Entity child = node(moved).firstChild; child != NULL_ENTITY; child = node(child).nextSibling)
+        {
+          if (child != removed)
+          {
+            mLevels[node(child).depth].parents[node(child).position] = position;
+          }
+        }
+      }
+      level.entities.pop_back();
+      level.parents.pop_back();
+      level.dirty.pop_back();
+    }
+
+    // Moves root's subtree to the levels starting at depth, parents first so
+    // every entity finds its parent's final position
+    inline void moveSubtree(Entity root, uint32_t depth)
+    {
+      int32_t offset = static_cast<int32_t>(depth) - static_cast<int32_t>(node(root).depth);
+      std::vector<Entity> pending{ root };
+      for (size_t i = 0; i < pending.size(); i++)
+      {
+        Entity entity = pending[i];
+        Node& entityNode = node(entity);
+        uint32_t newDepth = static_cast<uint32_t>(static_cast<int32_t>(entityNode.depth) + offset);
+        removeFromLevel(entityNode.depth, entityNode.position);
+        addToLevel(entity, newDepth);
+        for (Entity child = node(entity).firstChild; child != NULL_ENTITY; child = node(child).nextSibling)
+        {
+          pending.push_back(child);
+        }
+      }
+      while (!mLevels.empty() && mLevels.back().entities.empty())
+      {
+        mLevels.pop_back();
+      }
+    }
+  };
+
+  // What happens to the sources of a relation when its target is destroyed
+  enum class RelationCleanup
+  {
+    RemovePair,
+    DestroySource
+  };
+
+  // Lists of entities per entity, e.g. the targets of each source
+  class RelationIndex
+  {
+  public:
+    inline const std::vector<Entity>& get(Entity entity) const
+    {
+      static const std::vector<Entity> empty{};
+      return mEntities.contains(entity) ? mLists[mEntities.index(entity)] : empty;
+    }
+
+    inline std::vector<Entity>& assure(Entity entity)
+    {
+      if (!mEntities.contains(entity))
+      {
+        mEntities.insert(entity);
+        mLists.emplace_back();
+      }
+      return mLists[mEntities.index(entity)];
+    }
+
+    // Removes value from entity's list and returns whether it was in it
+    inline bool erase(Entity entity, Entity value)
+    {
+      if (!mEntities.contains(entity))
+      {
+        return false;
+      }
+
+      std::vector<Entity>& list = mLists[mEntities.index(entity)];
+      auto it = std::find(list.begin(), list.end(), value);
+      if (it == list.end())
+      {
+        return false;
+      }
+      *it = list.back();
+      list.pop_back();
+      if (list.empty())
+      {
+        take(entity);
+      }
+      return true;
+    }
+
+    // Removes entity's list and returns it
+    inline std::vector<Entity> take(Entity entity)
+    {
+      if (!mEntities.contains(entity))
+      {
+        return {};
+      }
+
+      size_t indexOfLastElement = mEntities.size() - 1;
+      size_t indexOfRemovedEntity = mEntities.erase(entity);
+      std::vector<Entity> list = std::move(mLists[indexOfRemovedEntity]);
+      if (indexOfRemovedEntity != indexOfLastElement)
+      {
+        mLists[indexOfRemovedEntity] = std::move(mLists[indexOfLastElement]);
+      }
+      mLists.pop_back();
+      return list;
+    }
+
+  public:
+    SparseSet mEntities{};
+
+    std::vector<std::vector<Entity>> mLists{}; // Parallel to mEntities' dense side
+  };
+
+  // The (source, target) pairs of one relation type, indexed both ways so
+  // that the targets of a source and the sources of a target are each one
+  // lookup away
+  class RelationArray
+  {
+  public:
+    inline RelationArray(ComponentType type, RelationCleanup cleanup)
+      : mType(type), mCleanup(cleanup)
+    {}
+
+    // Returns false if the pair exists already
+    inline bool add(Entity source, Entity target)
+    {
+      std::vector<Entity>& targets = mTargets.assure(source);
+      if (std::find(targets.begin(), targets.end(), target) != targets.end())
+      {
+        return false;
+      }
+      targets.push_back(target);
+      mSources.assure(target).push_back(source);
+      return true;
+    }
+
+    // Returns false if there was no such pair
+    inline bool remove(Entity source, Entity target)
+    {
+      if (!mTargets.erase(source, target))
+      {
+        return false;
+      }
+      mSources.erase(target, source);
+      return true;
+    }
+
+    inline bool has(Entity source, Entity target) const
+    {
+      const std::vector<Entity>& targets = mTargets.get(source);
+      return std::find(targets.begin(), targets.end(), target) != targets.end();
+    }
+
+    inline const std::vector<Entity>& getTargets(Entity source) const
+    {
+      return mTargets.get(source);
+    }
+
+    inline const std::vector<Entity>& getSources(Entity target) const
+    {
+      return mSources.get(target);
+    }
+
+    // Drops every pair involving entity and returns the sources that had it
+    // as target
+    inline std::vector<Entity> entityDestroyed(Entity entity)
+    {
+      for (Entity target : mTargets.take(entity))
+      {
+        mSources.erase(target, entity);
+      }
+
+      std::vector<Entity> sources = mSources.take(entity);
+      for (Entity source : sources)
+      {
+        mTargets.erase(source, entity);
+      }
+      return sources;
+    }
+
+  public:
+    ComponentType mType;
+    RelationCleanup mCleanup;
+    RelationIndex mTargets{}; // Per source
+    RelationIndex mSources{}; // Per target
+  };
+
+  // Singleton values of one world. Registering a type reserves a fixed spot
+  // for its value in a few shared pages, where the value is constructed in
+  // place, so setting a singleton doesn't allocate and the values of a world
+  // sit next to each other
+  class SingletonStorage
+  {
+  public:
+    static constexpr size_t PAGE_SIZE = 4096;
+
+    struct Slot
+    {
+      void* value; // Room for the value, constructed while set is true
+      void (*destroy)(void*);
+      bool set;
+    };
+
+    SingletonStorage() = default;
+    SingletonStorage(const SingletonStorage&) = delete;
+    SingletonStorage& operator=(const SingletonStorage&) = delete;
+
+    inline ~SingletonStorage()
+    {
+      for (Slot& slot : mSlots)
+      {
+        if (slot.set)
+        {
+          slot.destroy(slot.value);
+        }
+      }
+      for (auto const& [page, alignment] : mPages)
+      {
+        ::operator delete(page, std::align_val_t(alignment));
+      }
+    }
+
+    template<typename T>
+    inline void registerType()
+    {
+      size_t index = TypeIndex<SingletonStorage>::get<T>();
+      if (index >= mSlots.size())
+      {
+        mSlots.resize(index + 1, { nullptr, nullptr, false });
+      }
+      if (!mSlots[index].value)
+      {
+        mSlots[index] = { allocate(sizeof(T), alignof(T)), [](void* ptr) { static_cast<T*>(ptr)->~T(); }, false };
+      }
+    }
+
+    // Returns nullptr if T wasn't registered
+    template<typename T>
+    inline Slot* find()
+    {
+      size_t index = TypeIndex<SingletonStorage>::get<T>();
+      return index < mSlots.size() && mSlots[index].value ? &mSlots[index] : nullptr;
+    }
+
+  public:
+    std::vector<Slot> mSlots{}; // Indexed by TypeIndex<SingletonStorage>
+    std::vector<std::pair<void*, size_t>> mPages{}; // With their alignment
+    size_t mUsed = PAGE_SIZE; // Bytes taken from the last page
+
+  private:
+    // Values larger than a page get one of their own
+    inline void* allocate(size_t size, size_t alignment)
+    {
+      size_t offset = (mUsed + alignment - 1) & ~(alignment - 1);
+      if (mPages.empty() || alignment > mPages.back().second || offset + size > PAGE_SIZE)
+      {
+        size_t pageAlignment = std::max(alignment, alignof(std::max_align_t));
+        mPages.push_back({ ::operator new(std::max(size, PAGE_SIZE), std::align_val_t(pageAlignment)), pageAlignment });
+        offset = 0;
+      }
+      mUsed = offset + size;
+      return static_cast<std::byte*>(mPages.back().first) + offset;
+    }
+  };
+
+  // Where the Coordinator keeps component data: one ComponentArray per
+  // component type, or one Archetype table per signature
+  enum class StorageType
+  {
+    ComponentArrays,
+    Archetypes
+  };
+
+  // A world limited to Config::MAX_ENTITIES entities and
+  // Config::MAX_COMPONENTS component types, see WorldConfig
+  template<typename Config>
+  class BasicCoordinator
+  {
+  public:
+    using Signature = typename Config::Signature;
+    using Archetype = ecs::Archetype<Config>;
+    using ArchetypeManager = ecs::ArchetypeManager<Config>;
+    using EntityManager = ecs::EntityManager<Config>;
+    using SystemManager = ecs::SystemManager<Config>;
+
+    inline void init(StorageType storageType = StorageType::ComponentArrays)
+    {
+      mStorageType = storageType;
+      pComponentManager = new ComponentManager(Config::MAX_COMPONENTS);
+      pArchetypeManager = new ArchetypeManager();
+      pEntityManager = new EntityManager();
+      pSystemManager = new SystemManager();
+      pResourceManager = new ResourceManager();
+      pHierarchy = new Hierarchy();
+
+      registerComponent<Prefab>();
+    }
+
+    inline Entity createEntity()
+    {
+      return pEntityManager->createEntity();
+    }
+
+    // Creates an entity marked with the Prefab tag. Give it components as
+    // usual, then stamp out copies with instantiate
+    inline Entity createPrefab()
+    {
+      Entity prefab = createEntity();
+      addComponent(prefab, Prefab{});
+      return prefab;
+    }
+
+    // Creates count entities, each with copies of every component and
+    // relation pair of prefab except the Prefab tag. The copies are made one
+    // component type at a time, memcpy for trivially copyable types, and the
+    // signature and system membership are set once for the whole batch. Any
+    // entity works as prefab, unless one of its components isn't copy
+    // constructible, then nothing is created
+    inline EntityRange instantiate(Entity prefab, Entity count)
+    {
+      if (!pEntityManager->isAlive(prefab))
+      {
+        LOG_ERROR("Tried to instantiate non-existent entity");
+        assert(false);
+      }
+
+      Signature signature = pEntityManager->signature(prefab);
+      signature.reset(PREFAB_TYPE);
+      if (!pComponentManager->isCopyable(signature))
+      {
+        LOG_ERROR("Tried to instantiate entity with a component that isn't copy constructible - instantiating nothing");
+        return {};
+      }
+
+      EntityRange entities = pEntityManager->createEntities(count, signature);
+      if (mStorageType == StorageType::Archetypes)
+      {
+        auto first = pArchetypeManager->cloneEntities(prefab, entities, signature);
+        Signature rest = signature;
+        if (first.archetype)
+        {
+          for (ComponentType type : first.archetype->mTypes)
+          {
+            rest.reset(type);
+          }
+        }
+        pComponentManager->copyComponents(prefab, entities, rest);
+      }
+      else
+      {
+        pComponentManager->copyComponents(prefab, entities, signature);
+      }
+      copyRelations(prefab, entities, signature);
+
+      pSystemManager->entitiesCreated(entities, signature);
+      return entities;
+    }
+
+    // Returns NULL_ENTITY if entity can't be copied
+    inline Entity clone(Entity entity)
+    {
+      EntityRange copy = instantiate(entity, 1);
+      return copy.size() ? copy[0] : NULL_ENTITY;
+    }
+
+    // Reserves entities from any thread without locking, e.g. to spawn from
+    // jobs, reusing freed slots first. The handles are valid right away, but
+    // the entities only become alive, without components, at the next
+    // flushReservedEntities or createEntity(ies). Every other function of the
+    // Coordinator has to run on one thread at a time, and destroying entities
+    // must not overlap with reservations
+    inline Entity reserveEntity()
+    {
+      return pEntityManager->reserveEntity();
+    }
+
+    inline EntityRange reserveEntities(Entity count)
+    {
+      return pEntityManager->reserveEntities(count);
+    }
+
+    // Sync point making every reserved entity alive, after which components
+    // can be added to them. Must not run concurrently with other calls except
+    // reserveEntity and reserveEntities
+    inline void flushReservedEntities()
+    {
+      pEntityManager->flushReservedEntities();
+    }
+
+    // Creates count entities, each with value-initialized components Ts, then
+    // calls initializer(entity, components...) for each of them. Components
+    // are constructed one type at a time, and the signature and system
+    // membership are worked out once for the whole batch. Systems see the
+    // entities after initializer ran
+    template<typename... Ts, typename F>
+    inline EntityRange createEntities(Entity count, F&& initializer)
+    {
+      if (count == 0)
+      {
+        return {};
+      }
+
+      Signature signature{};
+      (signature.set(pComponentManager->getComponentType<Ts>()), ...);
+
+      EntityRange entities = pEntityManager->createEntities(count, signature);
+      if (mStorageType == StorageType::Archetypes)
+      {
+        auto first = pArchetypeManager->createEntities(entities, signature);
+        (constructRows<Ts>(entities, first.archetype, first.row), ...);
+        for (size_t i = 0; i < entities.size(); i++)
+        {
+          initializer(entities[i], getRowElement<Ts>(first.archetype, first.row + i, entities[i])...);
+        }
+      }
+      else
+      {
+        (constructComponents<Ts>(entities), ...);
+        for (Entity entity : entities)
+        {
+          // SoA components are handed out as gathered copies and written
+          // back once initializer is done with them
+          std::tuple<decltype(pComponentManager->getComponent<Ts>(entity))...> components{ pComponentManager->getComponent<Ts>(entity)... };
+          std::apply([&](auto&... elements) { initializer(entity, elements...); }, components);
+          (storeSoaComponent<Ts>(entity, components), ...);
+        }
+      }
+
+      pSystemManager->entitiesCreated(entities, signature);
+      return entities;
+    }
+
+    // Whether entity is a handle to a living entity, false once it was
+    // destroyed even if its index got reused
+    inline bool isAlive(Entity entity)
+    {
+      return pEntityManager->isAlive(entity);
+    }
+
+    inline void destroyEntity(Entity entity)
+    {
+      if (!pEntityManager->isAlive(entity))
+      {
+        LOG_ERROR("Tried to delete non-existent entity - deleting nothing");
+        return;
+      }
+
+      if (mPendingDestroy.contains(entity))
+      {
+        mPendingDestroy.erase(entity);
+      }
+
+      // Sources losing entity as target are dealt with once it's gone, so
+      // that cascades reaching it again find it dead
+      Orphans orphans{};
+      relationsDestroyed(entity, orphans);
+
+      const Signature signature = pEntityManager->signature(entity);
+      pEntityManager->destroyEntity(entity);
+      if (mStorageType == StorageType::Archetypes)
+      {
+        pArchetypeManager->entityDestroyed(entity);
+      }
+      pComponentManager->entityDestroyed(entity, signature);
+      pSystemManager->entityDestroyed(entity);
+      pHierarchy->entityDestroyed(entity);
+
+      releaseOrphans(orphans, false);
+    }
+
+    // Marks the entity for destruction by the next flushDestroyedEntities.
+    // Until then it stays alive and keeps its components, but forEach skips
+    // it. Systems keep listing it, and so do the raw views of forEachChunk,
+    // getSoaView and forEachSharedGroup; check isDestroyPending there
+    inline void destroyEntityDeferred(Entity entity)
+    {
+      if (!pEntityManager->isAlive(entity) || mPendingDestroy.contains(entity))
+      {
+        LOG_ERROR("Tried to delete non-existent entity - deleting nothing");
+        return;
+      }
+
+      mPendingDestroy.insert(entity);
+    }
+
+    inline bool isDestroyPending(Entity entity) const
+    {
+      return mPendingDestroy.contains(entity);
+    }
+
+    // Destroys every entity marked by destroyEntityDeferred, at a point where
+    // nothing iterates the world. Each storage removes the whole batch at
+    // once, highest position first, so only surviving elements get moved.
+    // Entities marked while flushing, e.g. by relation cleanup, are destroyed
+    // as well
+    inline void flushDestroyedEntities()
+    {
+      while (mPendingDestroy.size())
+      {
+        std::vector<Entity> entities = mPendingDestroy.entities();
+        mPendingDestroy.clear();
+        std::sort(entities.begin(), entities.end(), [](Entity a, Entity b)
+        {
+          return entityIndex(a) < entityIndex(b);
+        });
+
+        Orphans orphans{};
+        std::vector<Signature> signatures{};
+        signatures.reserve(entities.size());
+        for (Entity entity : entities)
+        {
+          relationsDestroyed(entity, orphans);
+          signatures.push_back(pEntityManager->signature(entity));
+          pEntityManager->destroyEntity(entity);
+        }
+
+        if (mStorageType == StorageType::Archetypes)
+        {
+          pArchetypeManager->entitiesDestroyed(entities);
+        }
+        pComponentManager->entitiesDestroyed(entities, signatures);
+        pSystemManager->entitiesDestroyed(entities);
+        for (Entity entity : entities)
+        {
+          pHierarchy->entityDestroyed(entity);
+        }
+
+        releaseOrphans(orphans, true);
+      }
+    }
+
+    template<typename T>
+    inline void registerComponent()
+    {
+      pComponentManager->registerComponent<T>();
+      if constexpr (hasArchetypeColumn<T>)
+      {
+        pArchetypeManager->registerComponent(pComponentManager->getComponentType<T>(), getComponentInfo<T>());
+      }
+      else
+      {
+        pArchetypeManager->registerComponent(pComponentManager->getComponentType<T>(), nullptr);
+      }
+    }
+
+    template<typename T>
+    inline void addComponent(Entity entity, T component)
+    {
+      emplaceComponent<T>(entity, std::move(component));
+    }
+
+    // Constructs the component from args directly in its storage
+    template<typename T, typename... Args>
+    inline void emplaceComponent(Entity entity, Args&&... args)
+    {
+      if (!pEntityManager->isAlive(entity))
+      {
+        LOG_ERROR("Tried adding component to non-existent entity - adding nothing");
+        return;
+      }
+
+      if constexpr (!hasArchetypeColumn<T>)
+      {
+        if (pEntityManager->signature(entity).test(pComponentManager->getComponentType<T>()))
+        {
+          LOG_ERROR("Tried adding same component to entity multiple times - adding nothing");
+          return;
+        }
+      }
+
+      if (mStorageType == StorageType::Archetypes)
+      {
+        if constexpr (hasArchetypeColumn<T>)
+        {
+          pArchetypeManager->template emplaceComponent<T>(entity, pComponentManager->getComponentType<T>(), std::forward<Args>(args)...);
+        }
+        else
+        {
+          // Built before the row moves, args may refer to the entity's other
+          // components
+          pComponentManager->emplaceComponent<T>(entity, std::forward<Args>(args)...);
+          pArchetypeManager->addComponent(entity, pComponentManager->getComponentType<T>());
+        }
+      }
+      else
+      {
+        pComponentManager->emplaceComponent<T>(entity, std::forward<Args>(args)...);
+      }
+
+      setComponentBit(entity, pComponentManager->getComponentType<T>(), true);
+    }
+
+    template<typename T>
+    inline void removeComponent(Entity entity)
+    {
+      if (!pEntityManager->isAlive(entity))
+      {
+        LOG_ERROR("Tried removing component of non-existent entity - removing nothing");
+        return;
+      }
+
+      if constexpr (!hasArchetypeColumn<T>)
+      {
+        if (!pEntityManager->signature(entity).test(pComponentManager->getComponentType<T>()))
+        {
+          LOG_ERROR("Tried removing non-existent entity - removing nothing");
+          return;
+        }
+      }
+
+      if (mStorageType == StorageType::Archetypes)
+      {
+        pArchetypeManager->removeComponent(entity, pComponentManager->getComponentType<T>());
+        if constexpr (!hasArchetypeColumn<T>)
+        {
+          pComponentManager->removeComponent<T>(entity);
+        }
+      }
+      else
+      {
+        pComponentManager->removeComponent<T>(entity);
+      }
+
+      setComponentBit(entity, pComponentManager->getComponentType<T>(), false);
+    }
+
+    // Returns a reference to the component. SoA components have no object to
+    // refer to, for them this returns a gathered copy. Shared components are
+    // returned as const references
+    template<typename T>
+    inline decltype(auto) getComponent(Entity entity)
+    {
+      if (!pEntityManager->isAlive(entity))
+      {
+        LOG_ERROR("Tried to retrieve data of non-existent entity");
+        assert(false);
+      }
+
+      if constexpr (isTagComponent<T>)
+      {
+        if (!pEntityManager->signature(entity).test(pComponentManager->getComponentType<T>()))
+        {
+          LOG_ERROR("Tried to retrieve data of non-existent entity");
+          assert(false);
+        }
+        return getTagInstance<T>();
+      }
+      else if constexpr (isSharedComponent<T>)
+      {
+        return pComponentManager->getComponent<T>(entity);
+      }
+      else
+      {
+        if (mStorageType == StorageType::Archetypes)
+        {
+          if constexpr (isSoaComponent<T>)
+          {
+            return T(pArchetypeManager->template getComponent<T>(entity, pComponentManager->getComponentType<T>()));
+          }
+          else
+          {
+            return pArchetypeManager->template getComponent<T>(entity, pComponentManager->getComponentType<T>());
+          }
+        }
+        return pComponentManager->getComponent<T>(entity);
+      }
+    }
+
+    // Registers a component type defined at runtime, e.g. from a data file.
+    // Its components are stored like native ones and it takes a signature
+    // bit like them. Returns the type to use with the functions below
+    inline ComponentType registerComponent(const ComponentInfo& info)
+    {
+      ComponentType type = pComponentManager->registerComponent(info);
+      if (type != ComponentManager::UNREGISTERED)
+      {
+        pArchetypeManager->registerComponent(type, &pComponentManager->getRuntimeArray(type)->mInfo);
+      }
+      return type;
+    }
+
+    inline ComponentType getComponentType(const char* name)
+    {
+      return pComponentManager->getComponentType(std::string(name));
+    }
+    inline ComponentType getComponentType(std::string name)
+    {
+      return pComponentManager->getComponentType(name);
+    }
+
+    // Adds a component of a runtime-defined type, copied from source or zero
+    // filled if source is nullptr. Returns the new component
+    inline void* addComponent(Entity entity, ComponentType type, const void* source)
+    {
+      if (!pEntityManager->isAlive(entity))
+      {
+        LOG_ERROR("Tried adding component to non-existent entity - adding nothing");
+        return nullptr;
+      }
+
+      const ComponentInfo& info = pComponentManager->getRuntimeArray(type)->mInfo;
+      auto construct = [&](void* component)
+      {
+        source ? info.copy(component, source) : void(std::memset(component, 0, info.size));
+      };
+
+      // With archetypes the copy is made before the entity's row moves, source
+      // may be one of its other components
+      void* component = nullptr;
+      if (mStorageType == StorageType::Archetypes)
+      {
+        pArchetypeManager->addComponent(entity, type, [&](void* memory)
+        {
+          component = memory;
+          construct(memory);
+        });
+      }
+      else if ((component = pComponentManager->addComponent(entity, type)))
+      {
+        construct(component);
+      }
+      if (!component)
+      {
+        return nullptr;
+      }
+
+      setComponentBit(entity, type, true);
+      return component;
+    }
+
+    inline void removeComponent(Entity entity, ComponentType type)
+    {
+      if (!pEntityManager->isAlive(entity))
+      {
+        LOG_ERROR("Tried removing component of non-existent entity - removing nothing");
+        return;
+      }
+
+      if (mStorageType == StorageType::Archetypes)
+      {
+        pArchetypeManager->removeComponent(entity, type);
+      }
+      else
+      {
+        pComponentManager->removeComponent(entity, type);
+      }
+
+      setComponentBit(entity, type, false);
+    }
+
+    inline void* getComponent(Entity entity, ComponentType type)
+    {
+      if (!pEntityManager->isAlive(entity))
+      {
+        LOG_ERROR("Tried to retrieve data of non-existent entity");
+        return nullptr;
+      }
+
+      if (mStorageType == StorageType::Archetypes)
+      {
+        return pArchetypeManager->getComponent(entity, type);
+      }
+      return pComponentManager->getComponent(entity, type);
+    }
+
+    // Calls func(count, entities, columns) once per archetype chunk holding
+    // entities with all of types, where columns[i] points to count components
+    // of types[i]. The runtime counterpart of forEachChunk<Ts...>, for
+    // component types only known at runtime. Entities pending destruction are
+    // included until flushDestroyedEntities
+    template<typename F>
+    inline void forEachChunk(const std::vector<ComponentType>& types, F&& func)
+    {
+      if (mStorageType != StorageType::Archetypes)
+      {
+        LOG_ERROR("Tried iterating chunks without archetype storage - iterating nothing");
+        return;
+      }
+
+      Signature signature{};
+      for (ComponentType type : types)
+      {
+        signature.set(type);
+      }
+
+      std::vector<void*> columns(types.size());
+      pArchetypeManager->forEachArchetype(signature, [&](Archetype& archetype)
+      {
+        for (auto& chunk : archetype.mChunks)
+        {
+          for (size_t i = 0; i < types.size(); i++)
+          {
+            int32_t column = archetype.getColumnIndex(types[i]);
+            columns[i] = column != Archetype::NO_COLUMN ? chunk.mData + archetype.mColumnOffsets[column] : nullptr;
+          }
+          func(chunk.mSize, chunk.getEntities(), static_cast<void* const*>(columns.data()));
+        }
+      });
+    }
+
+    // Calls func(value, entities) once per distinct value of the shared
+    // component T, so per-value work can be hoisted out of the entity loop.
+    // Entities pending destruction are included until flushDestroyedEntities
+    template<typename T, typename F>
+    inline void forEachSharedGroup(F&& func)
+    {
+      static_assert(isSharedComponent<T>, "forEachSharedGroup requires a component declared with ECS_SHARED_COMPONENT");
+      pComponentManager->getComponentArray<T>()->forEachGroup(std::forward<F>(func));
+    }
+
+    // Returns per-field columns over every component of the SoA type T, e.g.
+    // view.x[i] for i < view.size, belonging to view.entities[i]. Archetype
+    // storage keeps whole components in its chunk columns, use forEachChunk
+    // there. Entities pending destruction are included until
+    // flushDestroyedEntities
+    template<typename T>
+    inline typename SoaLayout<T>::View getSoaView()
+    {
+      static_assert(isSoaComponent<T>, "getSoaView requires a component declared with ECS_SOA_COMPONENT");
+      if (mStorageType == StorageType::Archetypes)
+      {
+        LOG_ERROR("Tried getting SoA view with archetype storage - viewing nothing");
+        return {};
+      }
+      return pComponentManager->getComponentArray<T>()->getView();
+    }
+
+    template<typename T>
+    inline ComponentType getComponentType()
+    {
+      return pComponentManager->getComponentType<T>();
+    }
+
+    // Calls func(count, entities, columns...) once per archetype chunk holding
+    // entities with all of Ts, where columns are pointers to count components
+    // each. Only available with archetype storage. Adding or removing
+    // components inside func is not allowed. Entities pending destruction are
+    // included until flushDestroyedEntities
+    template<typename... Ts, typename F>
+    inline void forEachChunk(F&& func)
+    {
+      if (mStorageType != StorageType::Archetypes)
+      {
+        LOG_ERROR("Tried iterating chunks without archetype storage - iterating nothing");
+        return;
+      }
+
+      Signature signature{};
+      (signature.set(pComponentManager->getComponentType<Ts>()), ...);
+
+      pArchetypeManager->forEachArchetype(signature, [&](Archetype& archetype)
+      {
+        for (auto& chunk : archetype.mChunks)
+        {
+          func(chunk.mSize, chunk.getEntities(), archetype.template getColumn<Ts>(chunk, pComponentManager->getComponentType<Ts>())...);
+        }
+      });
+    }
+
+    // Calls func(entity, components...) for every entity having all of Ts,
+    // except those pending destruction.
+    // With archetype storage this is a linear sweep over the matching tables,
+    // with component arrays it walks the first component's array and looks the
+    // others up per entity. Adding or removing components inside func is not
+    // allowed
+    template<typename... Ts, typename F>
+    inline void forEach(F&& func)
+    {
+      Signature signature{};
+      (signature.set(pComponentManager->getComponentType<Ts>()), ...);
+
+      if (mStorageType == StorageType::Archetypes)
+      {
+        forEachChunk<Ts...>([&](size_t count, Entity* entities, Ts*... columns)
+        {
+          for (size_t i = 0; i < count; i++)
+          {
+            if (!mPendingDestroy.contains(entities[i]))
+            {
+              func(entities[i], getChunkElement(columns, i, entities[i])...);
+            }
+          }
+        });
+        return;
+      }
+
+      // Tags have no entity list of their own to walk
+      using First = std::tuple_element_t<0, std::tuple<Ts...>>;
+      if constexpr (isTagComponent<First>)
+      {
+        pEntityManager->forEachEntity([&](Entity entity)
+        {
+          if (SystemManager::matches(pEntityManager->signature(entity), signature) && !mPendingDestroy.contains(entity))
+          {
+            func(entity, pComponentManager->getComponent<Ts>(entity)...);
+          }
+        });
+      }
+      else
+      {
+        for (Entity entity : pComponentManager->getComponentArray<First>()->mEntities.entities())
+        {
+          if (SystemManager::matches(pEntityManager->signature(entity), signature) && !mPendingDestroy.contains(entity))
+          {
+            func(entity, pComponentManager->getComponent<Ts>(entity)...);
+          }
+        }
+      }
+    }
+
+    // Singleton components exist once per world instead of per entity. They
+    // take a component type, so systems list them in their signature like any
+    // other component and only match entities while the singleton is set
+    template<typename T>
+    inline void registerSingleton()
+    {
+      pComponentManager->registerSingleton<T>();
+      mSingletons.registerType<T>();
+    }
+
+    // Constructs the singleton from args, replacing a previous value. args
+    // may refer to the previous value
+    template<typename T, typename... Args>
+    inline T& setSingleton(Args&&... args)
+    {
+      SingletonStorage::Slot* slot = mSingletons.find<T>();
+      if (!slot)
+      {
+        LOG_ERROR("Tried to set unregistered singleton");
+        assert(false);
+      }
+
+      T* value = static_cast<T*>(slot->value);
+      if (slot->set)
+      {
+        if constexpr (std::is_move_constructible_v<T>)
+        {
+          T replacement(std::forward<Args>(args)...);
+          value->~T();
+          new (value) T(std::move(replacement));
+        }
+        else
+        {
+          value->~T();
+          new (value) T(std::forward<Args>(args)...);
+        }
+        return *value;
+      }
+
+      new (value) T(std::forward<Args>(args)...);
+      slot->set = true;
+      singletonChanged(pComponentManager->getComponentType<T>(), true);
+      return *value;
+    }
+
+    template<typename T>
+    inline void removeSingleton()
+    {
+      if (!hasSingleton<T>())
+      {
+        LOG_ERROR("Tried removing singleton that isn't set - removing nothing");
+        return;
+      }
+
+      SingletonStorage::Slot* slot = mSingletons.find<T>();
+      static_cast<T*>(slot->value)->~T();
+      slot->set = false;
+      singletonChanged(pComponentManager->getComponentType<T>(), false);
+    }
+
+    template<typename T>
+    inline bool hasSingleton()
+    {
+      SingletonStorage::Slot* slot = mSingletons.find<T>();
+      return slot && slot->set;
+    }
+
+    template<typename T>
+    inline T& getSingleton()
+    {
+      SingletonStorage::Slot* slot = mSingletons.find<T>();
+      if (!slot || !slot->set)
+      {
+        LOG_ERROR("Tried to access singleton that isn't set");
+        assert(false);
+      }
+
+      return *static_cast<T*>(slot->value);
+    }
+
+    // Relations are pairs of a source and a target entity, e.g. Targets or
+    // DockedAt, declared as empty structs. An entity with any pair of R as
+    // source has R's bit in its signature, so systems and queries can require
+    // it. cleanup decides whether the sources of a destroyed target only lose
+    // the pair or get destroyed as well
+    template<typename R>
+    inline void registerRelation(RelationCleanup cleanup = RelationCleanup::RemovePair)
+    {
+      if (!pComponentManager->registerRelation<R>())
+      {
+        return;
+      }
+
+      ComponentType type = pComponentManager->getComponentType<R>();
+      pArchetypeManager->registerComponent(type, nullptr);
+
+      size_t index = TypeIndex<RelationArray>::get<R>();
+      if (index >= mRelations.size())
+      {
+        mRelations.resize(index + 1);
+      }
+      mRelations[index] = std::make_unique<RelationArray>(type, cleanup);
+    }
+
+    template<typename R>
+    inline void addRelation(Entity source, Entity target)
+    {
+      if (!pEntityManager->isAlive(source) || !pEntityManager->isAlive(target))
+      {
+        LOG_ERROR("Tried relating non-existent entity - adding nothing");
+        return;
+      }
+
+      RelationArray* relation = getRelationArray<R>();
+      if (!relation->add(source, target))
+      {
+        LOG_ERROR("Tried adding same relation pair multiple times - adding nothing");
+        return;
+      }
+      if (relation->getTargets(source).size() == 1)
+      {
+        setRelationBit(source, relation->mType, true);
+      }
+    }
+
+    template<typename R>
+    inline void removeRelation(Entity source, Entity target)
+    {
+      RelationArray* relation = getRelationArray<R>();
+      if (!relation->remove(source, target))
+      {
+        LOG_ERROR("Tried removing non-existent relation pair - removing nothing");
+        return;
+      }
+      if (relation->getTargets(source).empty())
+      {
+        setRelationBit(source, relation->mType, false);
+      }
+    }
+
+    template<typename R>
+    inline bool hasRelation(Entity source, Entity target)
+    {
+      return getRelationArray<R>()->has(source, target);
+    }
+
+    // Every target source relates to through R
+    template<typename R>
+    inline const std::vector<Entity>& getRelationTargets(Entity source)
+    {
+      return getRelationArray<R>()->getTargets(source);
+    }
+
+    // Every source relating to target through R, without scanning for them
+    template<typename R>
+    inline const std::vector<Entity>& getRelationSources(Entity target)
+    {
+      return getRelationArray<R>()->getSources(target);
+    }
+
+    // Makes child a child of parent, or a root again if parent is
+    // NULL_ENTITY. The child's subtree moves along with it. When an entity is
+    // destroyed its children become roots
+    inline void setParent(Entity child, Entity parent)
+    {
+      if (!pEntityManager->isAlive(child) || (parent != NULL_ENTITY && !pEntityManager->isAlive(parent)))
+      {
+        LOG_ERROR("Tried to parent non-existent entity - parenting nothing");
+        return;
+      }
+      pHierarchy->setParent(child, parent);
+    }
+
+    // Returns NULL_ENTITY for roots and entities outside the hierarchy
+    inline Entity getParent(Entity entity)
+    {
+      return pHierarchy->getParent(entity);
+    }
+
+    template<typename F>
+    inline void forEachChild(Entity entity, F&& func)
+    {
+      pHierarchy->forEachChild(entity, std::forward<F>(func));
+    }
+
+    // Flags entity's subtree for the next propagate, e.g. after changing its
+    // local transform
+    inline void markDirty(Entity entity)
+    {
+      pHierarchy->markDirty(entity);
+    }
+
+    // Calls func(entity, parent) for every entity in the hierarchy that was
+    // marked dirty or has a dirty ancestor, each parent before its children
+    // and with parent NULL_ENTITY for roots. Static subtrees are skipped
+    template<typename F>
+    inline void propagate(F&& func)
+    {
+      pHierarchy->propagate(std::forward<F>(func));
+    }
+
+    // Like propagate, calling func(component, parentComponent) with the T of
+    // each dirty entity and of its parent, or nullptr for roots. Every entity
+    // in the hierarchy needs a T. Each component is looked up once, children
+    // reuse their parent's from the level above
+    template<typename T, typename F>
+    inline void propagate(F&& func)
+    {
+      pHierarchy->template propagate<T>([&](Entity entity)
+      {
+        return &getComponent<T>(entity);
+      }, std::forward<F>(func));
+    }
+
+    template<typename T, typename... Args>
+    inline T* registerSystem(Args... args)
+    {
+      return pSystemManager->template registerSystem<T>(args...);
+    }
+
+    template<typename T>
+    inline void setSystemSignature(const Signature& signature)
+    {
+      pSystemManager->template setSignature<T>(signature);
+      systemsChanged();
+    }
+
+    template<typename T>
+    inline void registerResourceType()
+    {
+      pResourceManager->registerResourceType<T>();
     }
 
     template<typename T>
     inline T*& getResource(const char* key)
     {
-      const char* name = typeid(T).name();
-      return getResourceArray<T>()->getResource(key);
+      return pResourceManager->getResource<T>(key);
     }
     template<typename T>
     inline T*& getResource(std::string key)
@@ -462,8 +4227,7 @@ namespace ecs
     template<typename T>
     inline void setResource(const char* key, T* value)
     {
-      const char* name = typeid(T).name();
-      getResourceArray<T>()->setResource(key, value);
+      pResourceManager->setResource<T>(key, value);
     }
     template<typename T>
     inline void setResource(std::string key, T* value)
@@ -474,198 +4238,525 @@ namespace ecs
     template<typename T>
     inline void deleteResource(const char* key)
     {
-      getResourceArray<T>()->deleteResource(key);
+      pResourceManager->deleteResource<T>(key);
     }
     template<typename T>
     inline void deleteResource(std::string key)
     {
       deleteResource<T>(key.c_str());
     }
-
     template<typename... Args>
-    struct RecursiveDelete;
+    inline void deleteAllResources()
+    {
+      pResourceManager->deleteAll<Args...>();
+    }
 
-    template<typename First, typename... Args>
-    struct RecursiveDelete<First, Args...>
+    inline ~BasicCoordinator()
     {
-      static inline void deleteAll(ResourceManager& r)
+      // Archetypes refer to the infos of runtime types owned by the
+      // ComponentManager
+      delete pArchetypeManager;
+      delete pComponentManager;
+      delete pEntityManager;
+      delete pSystemManager;
+      delete pResourceManager;
+      delete pHierarchy;
+    }
+  public:
+    ComponentManager* pComponentManager;
+    ArchetypeManager* pArchetypeManager;
+    EntityManager* pEntityManager;
+    SystemManager* pSystemManager;
+    ResourceManager* pResourceManager;
+    Hierarchy* pHierarchy;
+    StorageType mStorageType{};
+    SingletonStorage mSingletons{};
+    std::vector<std::unique_ptr<RelationArray>> mRelations{}; // Indexed by TypeIndex<RelationArray>
+    SparseSet mPendingDestroy{}; // Marked by destroyEntityDeferred
+
+  private:
+    inline void setComponentBit(Entity entity, ComponentType type, bool value)
+    {
+      Signature& signature = pEntityManager->signature(entity);
+      signature.set(type, value);
+
+      pSystemManager->entityComponentChanged(entity, type, value, signature);
+    }
+
+    // Gives each of entities the relation pairs of source, so that the
+    // relation bits copied along with signature stay backed by pairs
+    inline void copyRelations(Entity source, const EntityRange& entities, const Signature& signature)
+    {
+      for (auto const& relation : mRelations)
       {
-        r.getResourceArray<First>()->deleteAll();
-        RecursiveDelete<Args...>::deleteAll(r);
+        if (relation && signature.test(relation->mType))
+        {
+          const std::vector<Entity> targets = relation->getTargets(source);
+          for (Entity entity : entities)
+          {
+            for (Entity target : targets)
+            {
+              relation->add(entity, target);
+            }
+          }
+        }
       }
-    };
-    template<>
-    struct RecursiveDelete<>
+    }
+
+    using Orphans = std::vector<std::pair<RelationArray*, std::vector<Entity>>>;
+
+    // Drops the relation pairs of a dying entity, collecting the sources that
+    // had it as target
+    inline void relationsDestroyed(Entity entity, Orphans& orphans)
     {
-      static inline void deleteAll(ResourceManager& r) { }
-    };
-    template<typename... Args>
-    void deleteAll()
+      for (auto const& relation : mRelations)
+      {
+        if (relation)
+        {
+          std::vector<Entity> sources = relation->entityDestroyed(entity);
+          if (!sources.empty())
+          {
+            orphans.push_back({ relation.get(), std::move(sources) });
+          }
+        }
+      }
+    }
+
+    inline void releaseOrphans(const Orphans& orphans, bool deferred)
     {
-      RecursiveDelete<Args...>::deleteAll(*this);
+      for (auto const& [relation, sources] : orphans)
+      {
+        for (Entity source : sources)
+        {
+          if (!pEntityManager->isAlive(source))
+          {
+            continue;
+          }
+          // Sources pending destruction go at the flush anyway, but until then
+          // they lose the relation bit like any other
+          if (relation->mCleanup == RelationCleanup::DestroySource)
+          {
+            if (mPendingDestroy.contains(source))
+            {
+              continue;
+            }
+            if (deferred)
+            {
+              destroyEntityDeferred(source);
+            }
+            else
+            {
+              destroyEntity(source);
+            }
+          }
+          // A source losing several targets at once is listed once per target
+          else if (relation->getTargets(source).empty() && pEntityManager->signature(source).test(relation->mType))
+          {
+            setRelationBit(source, relation->mType, false);
+          }
+        }
+      }
     }
 
-    inline ~ResourceManager()
+    template<typename R>
+    inline RelationArray* getRelationArray()
     {
-      for (auto& a : resourceArrays)
+      size_t index = TypeIndex<RelationArray>::get<R>();
+      if (index >= mRelations.size() || !mRelations[index])
       {
-        delete a.second;
+        LOG_ERROR("Tried to use unregistered relation!");
+        assert(false);
       }
+      return mRelations[index].get();
     }
-  private:
-    absl::flat_hash_map<const char*, IResourceArray*> resourceArrays;
 
-    template<typename T>
-    ResourceArray<T>* getResourceArray()
+    // Gaining the first or losing the last pair of a relation moves the
+    // source like a tag would
+    inline void setRelationBit(Entity source, ComponentType type, bool value)
     {
-      const char* typeName = typeid(T).name();
+      if (mStorageType == StorageType::Archetypes)
+      {
+        if (value)
+        {
+          pArchetypeManager->addComponent(source, type);
+        }
+        else
+        {
+          pArchetypeManager->removeComponent(source, type);
+        }
+      }
+      setComponentBit(source, type, value);
+    }
 
-      if(resourceArrays.find(typeName) == resourceArrays.end())
+    // Setting or removing a singleton changes which entities match the
+    // systems depending on it
+    inline void singletonChanged(ComponentType type, bool present)
+    {
+      pSystemManager->singletonChanged(type, present);
+      if (pSystemManager->dependsOn(type))
       {
-        LOG_ERROR("Tried to use unregistered component!");
-        assert(false);
+        systemsChanged();
       }
+    }
 
-      // return static_cast<ComponentArray<T>*>(mComponentArrays[typeName]);
-      // ComponentArray<T>* temp = mComponentArrays[typeName];
-      // return temp;
-      return reinterpret_cast<ResourceArray<T>*>(resourceArrays[typeName]);
+    // Brings every entity's system membership up to date after the system
+    // manager refreshed its nodes
+    inline void systemsChanged()
+    {
+      pEntityManager->forEachEntity([&](Entity entity)
+      {
+        pSystemManager->entityRefreshed(entity);
+      });
     }
-  };
 
-  class Coordinator
-  {
-  public:
-    inline void init()
+    template<typename T>
+    inline void constructComponents(const EntityRange& entities)
     {
-      pComponentManager = new ComponentManager();
-      pEntityManager = new EntityManager();
-      pSystemManager = new SystemManager();
-      pResourceManager = new ResourceManager();
+      for (Entity entity : entities)
+      {
+        pComponentManager->emplaceComponent<T>(entity);
+      }
     }
 
-    inline Entity createEntity()
+    template<typename T, typename Tuple>
+    inline void storeSoaComponent(Entity entity, Tuple& components)
     {
-      return pEntityManager->createEntity();
+      if constexpr (isSoaComponent<T>)
+      {
+        pComponentManager->getComponentArray<T>()->setData(entity, std::get<T>(components));
+      }
     }
 
-    inline void destroyEntity(Entity entity)
+    template<typename T>
+    inline void constructRows(const EntityRange& entities, Archetype* archetype, size_t firstRow)
     {
-      pEntityManager->destroyEntity(entity);
-      pComponentManager->entityDestroyed(entity);
-      pSystemManager->entityDestroyed(entity);
+      if constexpr (hasArchetypeColumn<T>)
+      {
+        int32_t column = archetype->getColumnIndex(pComponentManager->getComponentType<T>());
+        for (size_t row = firstRow; row < firstRow + entities.size(); row++)
+        {
+          new (archetype->getComponent(column, row)) T();
+        }
+      }
+      else
+      {
+        constructComponents<T>(entities);
+      }
     }
 
     template<typename T>
-    inline void registerComponent()
+    inline decltype(auto) getRowElement(Archetype* archetype, size_t row, Entity entity)
     {
-      pComponentManager->registerComponent<T>();
+      if constexpr (hasArchetypeColumn<T>)
+      {
+        return *static_cast<T*>(archetype->getComponent(archetype->getColumnIndex(pComponentManager->getComponentType<T>()), row));
+      }
+      else
+      {
+        return getChunkElement<T>(nullptr, row, entity);
+      }
     }
 
     template<typename T>
-    inline void addComponent(Entity entity, T component)
+    inline decltype(auto) getChunkElement(T* column, size_t index, Entity entity)
+    {
+      if constexpr (isTagComponent<T>)
+      {
+        return getTagInstance<T>();
+      }
+      else if constexpr (isSharedComponent<T>)
+      {
+        return pComponentManager->getComponent<T>(entity);
+      }
+      else
+      {
+        return (column[index]);
+      }
+    }
+  };
+
+  using Coordinator = BasicCoordinator<DefaultConfig>;
+
+  // Position of T in Ts...
+  template<typename T, typename... Ts>
+  struct TypeListIndex;
+
+  template<typename T, typename... Ts>
+  struct TypeListIndex<T, T, Ts...> : std::integral_constant<size_t, 0> {};
+
+  template<typename T, typename U, typename... Ts>
+  struct TypeListIndex<T, U, Ts...> : std::integral_constant<size_t, 1 + TypeListIndex<T, Ts...>::value> {};
+
+  // Bit set usable in constant expressions, which std::bitset isn't before
+  // libstdc++ 13. Bits past N are never set by set(), only by operator~
+  template<size_t N>
+  struct StaticBitset
+  {
+    static constexpr size_t WORD_COUNT = (N + 63) / 64;
+
+    std::array<uint64_t, WORD_COUNT> mWords{};
+
+    constexpr StaticBitset& set(size_t index)
     {
-      pComponentManager->addComponent<T>(entity, component);
+      mWords[index / 64] |= uint64_t{1} << (index % 64);
+      return *this;
+    }
 
-      auto signature = pEntityManager->getSignature(entity);
-      signature.set(pComponentManager->getComponentType<T>(), true);
-      pEntityManager->setSignature(entity, signature);
+    constexpr bool test(size_t index) const
+    {
+      return (mWords[index / 64] >> (index % 64)) & 1;
+    }
 
-      pSystemManager->entitySignatureChanged(entity, signature);
+    constexpr StaticBitset& operator|=(const StaticBitset& other)
+    {
+      for (size_t i = 0; i < WORD_COUNT; i++)
+      {
+        mWords[i] |= other.mWords[i];
+      }
+      return *this;
     }
 
-    template<typename T>
-    inline void removeComponent(Entity entity)
+    constexpr StaticBitset& operator&=(const StaticBitset& other)
     {
-      pComponentManager->removeComponent<T>(entity);
+      for (size_t i = 0; i < WORD_COUNT; i++)
+      {
+        mWords[i] &= other.mWords[i];
+      }
+      return *this;
+    }
 
-      auto signature = pEntityManager->getSignature(entity);
-      signature.set(pComponentManager->getComponentType<T>(), false);
-      pEntityManager->setSignature(entity, signature);
+    constexpr StaticBitset operator~() const
+    {
+      StaticBitset result{};
+      for (size_t i = 0; i < WORD_COUNT; i++)
+      {
+        result.mWords[i] = ~mWords[i];
+      }
+      return result;
+    }
 
-      pSystemManager->entitySignatureChanged(entity, signature);
+    friend constexpr StaticBitset operator|(StaticBitset a, const StaticBitset& b)
+    {
+      return a |= b;
     }
 
-    template<typename T>
-    inline T& getComponent(Entity entity)
+    friend constexpr StaticBitset operator&(StaticBitset a, const StaticBitset& b)
     {
-      return pComponentManager->getComponent<T>(entity);
+      return a &= b;
     }
 
+    constexpr bool operator==(const StaticBitset&) const = default;
+  };
+
+  // Smallest signature holding N bits: an unsigned integer up to 64 bits, a
+  // StaticBitset beyond
+  template<size_t N>
+  using StaticSignature =
+    std::conditional_t<(N <= 8), uint8_t,
+    std::conditional_t<(N <= 16), uint16_t,
+    std::conditional_t<(N <= 32), uint32_t,
+    std::conditional_t<(N <= 64), uint64_t, StaticBitset<N>>>>>;
+
+  // World whose full set of component types is known at compile time. Every
+  // component type gets its storage in a tuple and its signature bit from its
+  // position in Components, so all dispatch is resolved at compile time and
+  // no typeid, hash map or virtual call is involved. Uses the same storages as
+  // the ComponentManager, including tag, shared and SoA components
+  template<typename... Components>
+  class StaticWorld
+  {
+  public:
+    using Signature = StaticSignature<sizeof...(Components)>;
+
     template<typename T>
-    inline ComponentType getComponentType()
+    static constexpr size_t componentType = TypeListIndex<T, Components...>::value;
+
+    template<typename... Ts>
+    static constexpr Signature signatureOf()
     {
-      return pComponentManager->getComponentType<T>();
+      Signature signature{};
+      ((signature |= getBit<componentType<Ts>>()), ...);
+      return signature;
     }
 
-    template<typename T, typename... Args>
-    inline T* registerSystem(Args... args)
+    inline Entity createEntity()
     {
-      return pSystemManager->registerSystem<T>(args...);
+      if (mFreeHead != ENTITY_INDEX_MASK)
+      {
+        Entity index = mFreeHead;
+        mFreeHead = entityIndex(mEntities[index]);
+        mEntities[index] = makeEntity(index, entityGeneration(mEntities[index]));
+        return mEntities[index];
+      }
+
+      if (mSignatures.size() >= ENTITY_INDEX_MASK)
+      {
+        LOG_ERROR("Tried to create new entity, when no more entities are available");
+        assert(false);
+      }
+      Entity entity = makeEntity(static_cast<Entity>(mSignatures.size()), 0);
+      mSignatures.push_back(Signature{});
+      mEntities.push_back(entity);
+      return entity;
     }
 
-    template<typename T>
-    inline void setSystemSignature(Signature signature)
+    inline bool isAlive(Entity entity) const
     {
-      pSystemManager->setSignature<T>(signature);
+      Entity index = entityIndex(entity);
+      return index < mEntities.size() && mEntities[index] == entity;
     }
 
-    template<typename T>
-    inline void registerResourceType()
+    // Removes the entity's components, checking only the storages of the
+    // types it owns
+    inline void destroyEntity(Entity entity)
     {
-      pResourceManager->registerResourceType<T>();
+      if (!isAlive(entity))
+      {
+        LOG_ERROR("Tried to delete non-existent entity - deleting nothing");
+        return;
+      }
+
+      Entity index = entityIndex(entity);
+      removeOwned(entity, std::index_sequence_for<Components...>{});
+      mSignatures[index] = Signature{};
+      mEntities[index] = makeEntity(mFreeHead, entityGeneration(entity) + 1);
+      mFreeHead = index;
     }
 
     template<typename T>
-    inline T*& getResource(const char* key)
+    inline void addComponent(Entity entity, T component)
     {
-      return pResourceManager->getResource<T>(key);
+      emplaceComponent<T>(entity, std::move(component));
     }
-    template<typename T>
-    inline T*& getResource(std::string key)
+
+    template<typename T, typename... Args>
+    inline void emplaceComponent(Entity entity, Args&&... args)
     {
-      return getResource<T>(key.c_str());
+      if (!isAlive(entity))
+      {
+        LOG_ERROR("Tried adding component to non-existent entity - adding nothing");
+        return;
+      }
+
+      constexpr Signature bit = getBit<componentType<T>>();
+      if ((mSignatures[entityIndex(entity)] & bit) == bit)
+      {
+        LOG_ERROR("Tried adding same component to entity multiple times - adding nothing");
+        return;
+      }
+
+      getStorage<T>().emplaceData(entity, std::forward<Args>(args)...);
+      mSignatures[entityIndex(entity)] |= bit;
     }
 
     template<typename T>
-    inline void setResource(const char* key, T* value)
+    inline void removeComponent(Entity entity)
     {
-      pResourceManager->setResource<T>(key, value);
+      if (!isAlive(entity))
+      {
+        LOG_ERROR("Tried removing component of non-existent entity - removing nothing");
+        return;
+      }
+
+      constexpr Signature bit = getBit<componentType<T>>();
+      if ((mSignatures[entityIndex(entity)] & bit) != bit)
+      {
+        LOG_ERROR("Tried removing non-existent entity - removing nothing");
+        return;
+      }
+
+      getStorage<T>().removeData(entity);
+      mSignatures[entityIndex(entity)] &= ~bit;
     }
+
     template<typename T>
-    inline void setResource(std::string key, T* value)
+    inline bool hasComponent(Entity entity) const
     {
-      setResource<T>(key.c_str(), value);
+      constexpr Signature bit = getBit<componentType<T>>();
+      return isAlive(entity) && (mSignatures[entityIndex(entity)] & bit) == bit;
     }
 
     template<typename T>
-    inline void deleteResource(const char* key)
+    inline decltype(auto) getComponent(Entity entity)
     {
-      pResourceManager->deleteResource<T>(key);
+      if (!isAlive(entity))
+      {
+        LOG_ERROR("Tried to retrieve data of non-existent entity");
+        assert(false);
+      }
+      return getStorage<T>().getData(entity);
     }
-    template<typename T>
-    inline void deleteResource(std::string key)
+
+    // Empty for entities that aren't alive
+    inline Signature getSignature(Entity entity) const
     {
-      deleteResource<T>(key.c_str());
+      return isAlive(entity) ? mSignatures[entityIndex(entity)] : Signature{};
     }
-    template<typename... Args>
-    inline void deleteAllResources()
+
+    template<typename T>
+    inline ComponentArrayType<T>& getStorage()
     {
-      pResourceManager->deleteAll<Args...>();
+      return std::get<componentType<T>>(mStorages);
     }
 
-    inline ~Coordinator()
+    // Calls func(entity, components...) for every entity having all of Ts,
+    // walking the storage of the first of Ts. Adding or removing components
+    // inside func is not allowed
+    template<typename... Ts, typename F>
+    inline void forEach(F&& func)
     {
-      delete pComponentManager;
-      delete pEntityManager;
-      delete pSystemManager;
-      delete pResourceManager;
+      constexpr Signature signature = signatureOf<Ts...>();
+
+      using First = std::tuple_element_t<0, std::tuple<Ts...>>;
+      if constexpr (isTagComponent<First>)
+      {
+        for (Entity index = 0; index < mEntities.size(); index++)
+        {
+          Entity entity = mEntities[index];
+          if (entityIndex(entity) == index && (mSignatures[index] & signature) == signature)
+          {
+            func(entity, getComponent<Ts>(entity)...);
+          }
+        }
+      }
+      else
+      {
+        for (Entity entity : getStorage<First>().mEntities.entities())
+        {
+          if ((mSignatures[entityIndex(entity)] & signature) == signature)
+          {
+            func(entity, getComponent<Ts>(entity)...);
+          }
+        }
+      }
     }
+
   public:
-    ComponentManager* pComponentManager;
-    EntityManager* pEntityManager;
-    SystemManager* pSystemManager;
-    ResourceManager* pResourceManager;
+    std::tuple<ComponentArrayType<Components>...> mStorages{};
+    std::vector<Signature> mSignatures{};
+    std::vector<Entity> mEntities{}; // Per index the living entity, or the next free index with the next generation
+    Entity mFreeHead{ ENTITY_INDEX_MASK }; // First free slot, ENTITY_INDEX_MASK if there is none
+
+  private:
+    template<size_t I>
+    static constexpr Signature getBit()
+    {
+      if constexpr (std::is_integral_v<Signature>)
+      {
+        return static_cast<Signature>(Signature{1} << I);
+      }
+      else
+      {
+        return Signature{}.set(I);
+      }
+    }
+
+    template<size_t... I>
+    inline void removeOwned(Entity entity, std::index_sequence<I...>)
+    {
+      Signature signature = mSignatures[entityIndex(entity)];
+      ((((signature & getBit<I>()) == getBit<I>()) ? std::get<I>(mStorages).removeData(entity) : void()), ...);
+    }
   };
 }
 